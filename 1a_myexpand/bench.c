@@ -0,0 +1,442 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NO_MSG ""
+#define MAX_ARGS 32  // maximum number of arguments of a benchmarked command
+
+typedef struct {
+    char *bin;        // program name
+    char *dir;        // directory of the corpora (-d)
+    long size;        // size of each corpus in MiB (-s)
+    long runs;        // number of runs of each command, the fastest one is reported (-r)
+    char **command;   // the benchmarked myexpand and its extra arguments
+    int n_command;    // number of elements of command
+} args_t;
+
+/**
+ * @brief Measurements of a single run of a command
+ */
+typedef struct {
+    double seconds;         // wall-clock time
+    long long instructions; // user space instructions retired, -1 if they could not be counted
+    long max_rss;           // peak resident set size in KiB
+} run_t;
+
+/**
+ * @brief Generates the content of a corpus
+ * @details Writes about size bytes to f, drawing random numbers from *seed
+ */
+typedef void (*generator_t)(FILE *f, size_t size, uint64_t *seed);
+
+/**
+ * @brief A synthetic input file
+ */
+typedef struct {
+    const char *name;       // file name inside the corpus directory
+    generator_t generate;   // writes the content
+} corpus_t;
+
+/* Global configuration */
+args_t args = {.dir = "bench_data", .size = 32, .runs = 3};
+
+/* Tab stops every corpus is expanded with */
+static const char *tab_stops[] = {"1", "4", "8", "13", "4,12,20,/8"};
+
+/**
+ * @brief Typical usage method
+ */
+static void usage(char *msg) {
+    if (strcmp(msg, NO_MSG) != 0) {
+        fprintf(stderr, "Error: %s\n", msg);
+    }
+    fprintf(stderr, "Usage: %s [-d dir] [-s MiB] [-r runs] myexpand [option...]\n", args.bin);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Typical exit method
+ */
+static void error_exit(char *msg) {
+    if (strcmp(msg, NO_MSG) != 0) {
+        fprintf(stderr, "%s\n", msg);
+    }
+    fprintf(stderr, "Error: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Typical argument handling
+ *
+ * @param argc Number of arguments
+ * @param argv The arguments
+ */
+static void handle_args(int argc, char **argv) {
+    args.bin = argv[0];
+
+    int cur;
+    char *end;
+    /* "+" stops at the first non-option, so that the options of myexpand are passed on */
+    while ((cur = getopt(argc, argv, "+d:s:r:")) != -1) {
+        switch (cur) {
+            case 'd':
+                args.dir = optarg;
+                break;
+            case 's':
+                args.size = strtol(optarg, &end, 10);
+                if (*end != '\0' || args.size < 1) {
+                    usage("Argument for option -s is not an integer >= 1");
+                }
+                break;
+            case 'r':
+                args.runs = strtol(optarg, &end, 10);
+                if (*end != '\0' || args.runs < 1) {
+                    usage("Argument for option -r is not an integer >= 1");
+                }
+                break;
+            default:
+                usage(NO_MSG);
+        }
+    }
+
+    if (optind == argc) {
+        usage("No myexpand binary was provided");
+    }
+    args.command = argv + optind;
+    args.n_command = argc - optind;
+    if (args.n_command > MAX_ARGS - 4) {
+        usage("Too many options for myexpand");
+    }
+}
+
+/**
+ * @brief Draws a random number with xorshift64*
+ */
+static uint64_t next_random(uint64_t *seed) {
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return *seed * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * @brief Writes n random lower-case letters and spaces
+ */
+static void put_words(FILE *f, size_t n, uint64_t *seed) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = next_random(seed);
+        putc(r % 6 == 0 ? ' ' : 'a' + (r >> 8) % 26, f);
+    }
+}
+
+/**
+ * @brief Prose without any tabs, lines of 40 to 120 bytes
+ */
+static void generate_notab(FILE *f, size_t size, uint64_t *seed) {
+    for (size_t written = 0; written < size;) {
+        size_t len = 40 + next_random(seed) % 81;
+        put_words(f, len, seed);
+        putc('\n', f);
+        written += len + 1;
+    }
+}
+
+/**
+ * @brief Tab separated values, 12 short fields per line
+ */
+static void generate_tsv(FILE *f, size_t size, uint64_t *seed) {
+    for (size_t written = 0; written < size;) {
+        for (int field = 0; field < 12; field++) {
+            size_t len = 1 + next_random(seed) % 10;
+            put_words(f, len, seed);
+            putc(field == 11 ? '\n' : '\t', f);
+            written += len + 1;
+        }
+    }
+}
+
+/**
+ * @brief Lines of 64 to 192 KiB with a tab every 1 KiB on average
+ */
+static void generate_long(FILE *f, size_t size, uint64_t *seed) {
+    for (size_t written = 0; written < size;) {
+        size_t len = (64 + next_random(seed) % 129) << 10;
+        for (size_t i = 0; i < len; i++) {
+            uint64_t r = next_random(seed);
+            putc(r % 1024 == 0 ? '\t' : 'a' + (r >> 16) % 26, f);
+        }
+        putc('\n', f);
+        written += len + 1;
+    }
+}
+
+/**
+ * @brief Lines of 0 to 8 bytes that start with a tab half of the time
+ */
+static void generate_short(FILE *f, size_t size, uint64_t *seed) {
+    for (size_t written = 0; written < size;) {
+        uint64_t r = next_random(seed);
+        size_t len = r % 9;
+        if (len > 0 && (r >> 8) % 2 == 0) {
+            putc('\t', f);
+            len--;
+            written++;
+        }
+        put_words(f, len, seed);
+        putc('\n', f);
+        written += len + 1;
+    }
+}
+
+/**
+ * @brief Indented lines mixing ASCII with two, three and four byte UTF-8 sequences
+ */
+static void generate_utf8(FILE *f, size_t size, uint64_t *seed) {
+    static const char *symbols[] = {"\xc3\xa4", "\xc3\xb6", "\xc3\xbc", "\xc3\x9f", "\xe2\x82\xac", "\xe2\x86\x92",
+                                    "\xe6\x97\xa5", "\xf0\x9f\x99\x82"};
+    for (size_t written = 0; written < size;) {
+        int fields = 1 + next_random(seed) % 6;
+        for (int field = 0; field < fields; field++) {
+            putc('\t', f);
+            written++;
+            for (int i = next_random(seed) % 16; i > 0; i--) {
+                uint64_t r = next_random(seed);
+                if (r % 4 == 0) {
+                    const char *s = symbols[(r >> 8) % 8];
+                    fputs(s, f);
+                    written += strlen(s);
+                } else {
+                    putc('a' + (r >> 8) % 26, f);
+                    written++;
+                }
+            }
+        }
+        putc('\n', f);
+        written++;
+    }
+}
+
+/* All corpora */
+static const corpus_t corpora[] = {
+    {"notab.txt", generate_notab},
+    {"tsv.txt", generate_tsv},
+    {"long.txt", generate_long},
+    {"short.txt", generate_short},
+    {"utf8.txt", generate_utf8},
+};
+
+/**
+ * @brief Writes a corpus unless it already exists with at least the requested size
+ *
+ * @param path The path of the corpus
+ * @param corpus The corpus
+ * @param size The requested size in bytes
+ */
+static void generate(const char *path, const corpus_t *corpus, size_t size) {
+    struct stat st;
+    if (stat(path, &st) == 0 && (size_t)st.st_size >= size && (size_t)st.st_size < size + (1 << 20)) {
+        return;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        error_exit("fopen failed");
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    corpus->generate(f, size, &seed);
+    if (fclose(f) == EOF) {
+        error_exit("fclose failed");
+    }
+}
+
+/**
+ * @brief Opens a counter of the user space instructions of a process and its children
+ * @details The counter starts when the process calls exec
+ *
+ * @param pid The process
+ * @return int The descriptor of the counter, -1 if it is not available
+ */
+static int open_counter(pid_t pid) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
+}
+
+/**
+ * @brief Runs a command with its output discarded
+ *
+ * @param argv The command, terminated by NULL
+ * @return run_t The measurements
+ */
+static run_t run(char **argv) {
+    /* The child waits until the counter is attached, so that exec enables it */
+    int ready[2];
+    if (pipe(ready) == -1) {
+        error_exit("pipe failed");
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == -1) {
+        error_exit("fork failed");
+    }
+    if (pid == 0) {
+        char c;
+        close(ready[1]);
+        if (read(ready[0], &c, 1) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+        int null = open("/dev/null", O_WRONLY);
+        if (null == -1 || dup2(null, STDOUT_FILENO) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+        execvp(argv[0], argv);
+        fprintf(stderr, "Error: cannot execute %s: %s\n", argv[0], strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+
+    close(ready[0]);
+    int counter = open_counter(pid);
+    close(ready[1]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        error_exit("wait4 failed");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error: %s failed\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    run_t r = {.instructions = -1, .max_rss = usage.ru_maxrss};
+    r.seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (counter != -1) {
+        long long count;
+        if (read(counter, &count, sizeof(count)) == sizeof(count)) {
+            r.instructions = count;
+        }
+        close(counter);
+    }
+    return r;
+}
+
+/**
+ * @brief Runs a command args.runs times and keeps the fastest run
+ *
+ * @param argv The command, terminated by NULL
+ * @return run_t The measurements of the fastest run, with the peak RSS of all runs
+ */
+static run_t best_of(char **argv) {
+    run_t best = run(argv);
+    for (long i = 1; i < args.runs; i++) {
+        run_t r = run(argv);
+        if (r.max_rss > best.max_rss) {
+            best.max_rss = r.max_rss;
+        }
+        if (r.seconds < best.seconds) {
+            r.max_rss = best.max_rss;
+            best = r;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Prints a row of the result table
+ *
+ * @param corpus The name of the corpus
+ * @param tabs The tab stops
+ * @param tool The name of the tool
+ * @param r The measurements
+ * @param size The size of the corpus in bytes
+ * @param baseline The throughput of GNU expand in MB/s, 0 for its own row
+ */
+static void report(const char *corpus, const char *tabs, const char *tool, run_t r, size_t size, double baseline) {
+    double mbs = size / r.seconds / 1e6;
+    printf("%-10s %-11s %-9s %9.1f", corpus, tabs, tool, mbs);
+    if (r.instructions >= 0) {
+        printf(" %9.2f", (double)r.instructions / size);
+    } else {
+        printf(" %9s", "n/a");
+    }
+    printf(" %9.1f", r.max_rss / 1024.0);
+    if (baseline > 0) {
+        printf(" %7.2fx", mbs / baseline);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+/**
+ * @brief Program entry point
+ * @details Generates the corpora and compares the given myexpand against GNU expand on each of
+ * them with every tab stop setting
+ *
+ * @param argc Number of arguments
+ * @param argv The arguments
+ * @return int EXIT_SUCCESS if all commands succeeded
+ */
+int main(int argc, char **argv) {
+    handle_args(argc, argv);
+
+    if (mkdir(args.dir, 0755) == -1 && errno != EEXIST) {
+        error_exit("mkdir failed");
+    }
+    size_t size = (size_t)args.size << 20;
+    size_t n_corpora = sizeof(corpora) / sizeof(corpora[0]);
+    size_t n_tabs = sizeof(tab_stops) / sizeof(tab_stops[0]);
+
+    printf("%-10s %-11s %-9s %9s %9s %9s %8s\n", "corpus", "tabs", "tool", "MB/s", "instr/B", "RSS MiB", "speedup");
+    for (size_t c = 0; c < n_corpora; c++) {
+        char path[strlen(args.dir) + strlen(corpora[c].name) + 2];
+        sprintf(path, "%s/%s", args.dir, corpora[c].name);
+        generate(path, &corpora[c], size);
+
+        struct stat st;
+        if (stat(path, &st) == -1) {
+            error_exit("stat failed");
+        }
+
+        for (size_t t = 0; t < n_tabs; t++) {
+            char *gnu[] = {"expand", "-t", (char *)tab_stops[t], path, NULL};
+            run_t baseline = best_of(gnu);
+            report(corpora[c].name, tab_stops[t], "expand", baseline, st.st_size, 0);
+
+            char *mine[MAX_ARGS];
+            int n = 0;
+            for (int i = 0; i < args.n_command; i++) {
+                mine[n++] = args.command[i];
+            }
+            mine[n++] = "-t";
+            mine[n++] = (char *)tab_stops[t];
+            mine[n++] = path;
+            mine[n] = NULL;
+            report(corpora[c].name, tab_stops[t], "myexpand", best_of(mine), st.st_size,
+                   st.st_size / baseline.seconds / 1e6);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC "myexpand-cache"  // first word of a cache file
+#define HASH_SEED 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+/**
+ * @brief Hashes a device and inode into a slot index
+ *
+ * @param cache The cache
+ * @param dev The device
+ * @param ino The inode
+ * @return size_t The first slot to be probed
+ */
+static size_t slot_of(const cache_t *cache, dev_t dev, ino_t ino) {
+    uint64_t h = ((uint64_t)dev * HASH_PRIME) ^ (uint64_t)ino;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h & (cache->cap - 1);
+}
+
+/**
+ * @brief Inserts an entry, replacing one with the same device and inode
+ *
+ * @param cache The cache, which must have a free slot
+ * @param e The entry to be inserted
+ */
+static void insert(cache_t *cache, const cache_entry_t *e) {
+    size_t i = slot_of(cache, e->dev, e->ino);
+    while (cache->slots[i].used && (cache->slots[i].dev != e->dev || cache->slots[i].ino != e->ino)) {
+        i = (i + 1) & (cache->cap - 1);
+    }
+    cache->slots[i] = *e;
+}
+
+/**
+ * @brief Doubles the number of slots
+ *
+ * @param cache The cache
+ * @return int 0 on success, -1 on failure
+ */
+static int grow(cache_t *cache) {
+    cache_t bigger = {.cap = cache->cap * 2, .stamp = cache->stamp};
+    bigger.slots = calloc(bigger.cap, sizeof(cache_entry_t));
+    if (bigger.slots == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < cache->cap; i++) {
+        if (cache->slots[i].used) {
+            insert(&bigger, &cache->slots[i]);
+        }
+    }
+    free(cache->slots);
+    *cache = bigger;
+    return 0;
+}
+
+uint64_t cache_hash(const void *buf, size_t len) {
+    /* FNV-1a on 8 byte words, with a final mix so that all bits depend on the last word */
+    const unsigned char *p = buf;
+    uint64_t h = HASH_SEED ^ len;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * HASH_PRIME;
+    }
+    for (; len > 0; p++, len--) {
+        h = (h ^ *p) * HASH_PRIME;
+    }
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    return h ^ (h >> 32);
+}
+
+int cache_load(cache_t *cache, const char *path, uint64_t settings) {
+    cache->cap = 1024;
+    cache->stamp = 0;
+    cache->slots = calloc(cache->cap, sizeof(cache_entry_t));
+    if (cache->slots == NULL) {
+        return -1;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    int version;
+    unsigned long long file_settings;
+    long long stamp;
+    if (fscanf(f, CACHE_MAGIC " %d %llx %lld\n", &version, &file_settings, &stamp) != 3 ||
+        version != CACHE_VERSION || file_settings != settings) {
+        fclose(f);
+        return 0;
+    }
+    cache->stamp = stamp;
+
+    size_t n = 0;
+    unsigned long long dev, ino, hash;
+    long long size, sec;
+    long nsec;
+    while (fscanf(f, "%llu %llu %lld %lld %ld %llx\n", &dev, &ino, &size, &sec, &nsec, &hash) == 6) {
+        if (2 * (n + 1) > cache->cap && grow(cache) == -1) {
+            fclose(f);
+            return -1;
+        }
+        cache_entry_t e = {.used = 1, .dev = dev, .ino = ino, .size = size, .hash = hash};
+        e.mtime.tv_sec = sec;
+        e.mtime.tv_nsec = nsec;
+        insert(cache, &e);
+        n++;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+const cache_entry_t *cache_find(const cache_t *cache, const struct stat *st) {
+    size_t i = slot_of(cache, st->st_dev, st->st_ino);
+    while (cache->slots[i].used) {
+        if (cache->slots[i].dev == st->st_dev && cache->slots[i].ino == st->st_ino) {
+            return &cache->slots[i];
+        }
+        i = (i + 1) & (cache->cap - 1);
+    }
+    return NULL;
+}
+
+int cache_is_fresh(const cache_t *cache, const cache_entry_t *e, const struct stat *st) {
+    return e->size == st->st_size && e->mtime.tv_sec == st->st_mtim.tv_sec &&
+           e->mtime.tv_nsec == st->st_mtim.tv_nsec && e->mtime.tv_sec < cache->stamp;
+}
+
+void cache_set(cache_entry_t *e, const struct stat *st, uint64_t hash) {
+    e->used = 1;
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->size = st->st_size;
+    e->mtime = st->st_mtim;
+    e->hash = hash;
+}
+
+int cache_save(const char *path, uint64_t settings, time_t stamp, const cache_entry_t *entries, size_t n) {
+    char tmp[strlen(path) + sizeof(".XXXXXX")];
+    sprintf(tmp, "%s.XXXXXX", path);
+    int fd = mkstemp(tmp);
+    if (fd == -1) {
+        return -1;
+    }
+    FILE *f = fdopen(fd, "w");
+    if (f == NULL) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+
+    fprintf(f, CACHE_MAGIC " %d %llx %lld\n", CACHE_VERSION, (unsigned long long)settings, (long long)stamp);
+    for (size_t i = 0; i < n; i++) {
+        const cache_entry_t *e = &entries[i];
+        if (e->used) {
+            fprintf(f, "%llu %llu %lld %lld %ld %llx\n", (unsigned long long)e->dev, (unsigned long long)e->ino,
+                    (long long)e->size, (long long)e->mtime.tv_sec, e->mtime.tv_nsec, (unsigned long long)e->hash);
+        }
+    }
+
+    if (ferror(f) || fchmod(fd, 0644) == -1) {
+        int err = errno;
+        fclose(f);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    if (fclose(f) == EOF || rename(tmp, path) == -1) {
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void cache_free(cache_t *cache) {
+    free(cache->slots);
+    cache->slots = NULL;
+}
@@ -0,0 +1,110 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define CACHE_VERSION 1  // format version of the cache file
+
+/**
+ * @brief What is known about a file that was normalized before
+ * @param used Whether the entry is valid
+ * @param dev The device of the file
+ * @param ino The inode of the file
+ * @param size The size of the file
+ * @param mtime The modification time of the file
+ * @param hash The cache_hash of the (normalized) content of the file
+ */
+typedef struct {
+    int used;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint64_t hash;
+} cache_entry_t;
+
+/**
+ * @brief The entries of a cache file in an open-addressing hash table keyed by device and inode
+ * @param slots The hash table
+ * @param cap The number of slots, a power of two
+ * @param stamp When the cache file was written, files modified at or after that time are not trusted
+ */
+typedef struct {
+    cache_entry_t *slots;
+    size_t cap;
+    time_t stamp;
+} cache_t;
+
+/**
+ * @brief Hashes len bytes
+ *
+ * @param buf The bytes to be hashed
+ * @param len The number of bytes
+ * @return uint64_t The hash
+ */
+uint64_t cache_hash(const void *buf, size_t len);
+
+/**
+ * @brief Loads a cache file
+ * @details A missing cache file, or one written by another version or with other settings, yields an empty cache
+ *
+ * @param cache The cache to be filled
+ * @param path The path of the cache file
+ * @param settings A hash of all settings that influence the content of a normalized file
+ * @return int 0 on success, -1 on failure with errno set
+ */
+int cache_load(cache_t *cache, const char *path, uint64_t settings);
+
+/**
+ * @brief Looks up the entry of a file
+ *
+ * @param cache The cache
+ * @param st The status of the file
+ * @return const cache_entry_t* The entry with the same device and inode, or NULL if there is none
+ */
+const cache_entry_t *cache_find(const cache_t *cache, const struct stat *st);
+
+/**
+ * @brief Checks whether a file can be skipped without reading it
+ * @details This is the case if its size and modification time are those of the entry and it was not modified
+ * in the same second the cache was written (it could have been modified again within the same second then)
+ *
+ * @param cache The cache
+ * @param e The entry of the file
+ * @param st The current status of the file
+ * @return int 1 if the file is unchanged, 0 otherwise
+ */
+int cache_is_fresh(const cache_t *cache, const cache_entry_t *e, const struct stat *st);
+
+/**
+ * @brief Fills an entry with the status of a file and the hash of its content
+ *
+ * @param e The entry to be filled
+ * @param st The status of the file
+ * @param hash The hash of its content
+ */
+void cache_set(cache_entry_t *e, const struct stat *st, uint64_t hash);
+
+/**
+ * @brief Atomically replaces the cache file with the used ones of n entries
+ *
+ * @param path The path of the cache file
+ * @param settings A hash of all settings that influence the content of a normalized file
+ * @param stamp When the entries started to be collected
+ * @param entries The entries
+ * @param n The number of entries
+ * @return int 0 on success, -1 on failure with errno set
+ */
+int cache_save(const char *path, uint64_t settings, time_t stamp, const cache_entry_t *entries, size_t n);
+
+/**
+ * @brief Frees the memory held by a cache
+ *
+ * @param cache The cache
+ */
+void cache_free(cache_t *cache);
+
+#endif
@@ -0,0 +1,616 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expand.h"
+
+/* The vectorized scanners need GCC/clang on x86, compile with -DNO_SIMD to force the scalar one */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_SIMD)
+#define HAVE_SIMD
+#include <immintrin.h>
+#endif
+
+#define SPACES_SIZE 64              // length of the static space buffer
+#define TAB_TABLE_SLACK 4096        // number of columns behind the last explicit tab stop covered by the tab table
+#define TAB_TABLE_MAX (1 << 20)     // maximum number of columns covered by the tab table
+#define DEFAULT_TABS "8"            // tab stops used if none are given
+
+/* Source of the spaces that replace a tab */
+static const char spaces[SPACES_SIZE + 1] = "                                                                ";
+
+/**
+ * @brief Parses a tab stop list into the stops, repeat and relative members of config
+ *
+ * @param config The configuration to be filled
+ * @param list A writable copy of the tab stop list
+ * @return const char* NULL on success, otherwise a description of the problem
+ */
+static const char *parse_tabs(expand_config_t *config, char *list) {
+    char *save;
+    for (char *token = strtok_r(list, ", ", &save); token != NULL; token = strtok_r(NULL, ", ", &save)) {
+        if (config->repeat != 0) {
+            return "Only the last tab stop may be prefixed with / or +";
+        }
+        char prefix = *token == '/' || *token == '+' ? *token++ : '\0';
+
+        char *end;
+        errno = 0;
+        long stop = strtol(token, &end, 10);
+        if (!(*token >= '0' && *token <= '9') || *end != '\0' || errno == ERANGE) {
+            return "Tab stops are not a list of integers";
+        }
+        if (stop < 1) {
+            return "Tab stops must be > 0";
+        }
+
+        if (prefix != '\0') {
+            config->repeat = stop;
+            config->relative = prefix == '+';
+        } else if (config->n > 0 && (size_t)stop <= config->stops[config->n - 1]) {
+            return "Tab stops must be ascending";
+        } else {
+            config->stops[config->n++] = stop;
+        }
+    }
+
+    /* A single number is a tab size, not a tab stop */
+    if (config->n == 1 && config->repeat == 0) {
+        config->repeat = config->stops[0];
+        config->n = 0;
+    }
+    if (config->n == 0 && config->repeat == 0) {
+        return "Tab stops are not a list of integers";
+    }
+    return NULL;
+}
+
+/**
+ * @brief Width of a tab at column x, for the columns beyond the tab table
+ *
+ * @param config The configuration
+ * @param x The column of the tab
+ * @return size_t The number of spaces the tab expands to
+ */
+static size_t tab_width_slow(const expand_config_t *config, size_t x) {
+    size_t last = config->n > 0 ? config->stops[config->n - 1] : 0;
+    if (x < last) {
+        /* Binary search for the first explicit stop behind x */
+        size_t lo = 0, hi = config->n - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (config->stops[mid] > x) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return config->stops[lo] - x;
+    }
+    if (config->repeat == 0) {
+        return 1;
+    }
+    return config->repeat - (x - (config->relative ? last : 0)) % config->repeat;
+}
+
+/**
+ * @brief Builds the tab table, so that a tab costs a single lookup for all but very long lines
+ * @details Every stop s fills the columns in front of it with s - x, so no division is needed.
+ * The table ends TAB_TABLE_SLACK columns behind the last explicit stop, but covers at most TAB_TABLE_MAX columns.
+ *
+ * @param config The configuration whose table is built
+ * @return int 0 on success, -1 if the table could not be allocated
+ */
+static int compile_tabs(expand_config_t *config) {
+    size_t last = config->n > 0 ? config->stops[config->n - 1] : 0;
+    config->size = last < TAB_TABLE_MAX - TAB_TABLE_SLACK ? last + TAB_TABLE_SLACK : TAB_TABLE_MAX;
+    config->table = malloc(config->size * sizeof(size_t));
+    if (config->table == NULL) {
+        return -1;
+    }
+
+    size_t x = 0;
+    for (size_t i = 0; i < config->n; i++) {
+        for (; x < config->stops[i] && x < config->size; x++) {
+            config->table[x] = config->stops[i] - x;
+        }
+    }
+
+    if (config->repeat == 0) {
+        for (; x < config->size; x++) {
+            config->table[x] = 1;
+        }
+        return 0;
+    }
+    size_t stop = config->relative ? last + config->repeat : (last / config->repeat + 1) * config->repeat;
+    for (; x < config->size; stop += config->repeat) {
+        for (; x < stop && x < config->size; x++) {
+            config->table[x] = stop - x;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Counts the columns occupied by len bytes without tabs and newlines
+ * @details In UTF-8 mode, every byte except for continuation bytes starts a new code point.
+ * Invalid bytes therefore occupy a column each.
+ *
+ * @param buf The bytes to be counted
+ * @param len The number of bytes
+ * @param utf8 Whether columns are counted in UTF-8 code points
+ * @return size_t The number of columns
+ */
+static size_t count_columns(const char *buf, size_t len, int utf8) {
+    if (!utf8) {
+        return len;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        n += ((unsigned char)buf[i] & 0xC0) != 0x80;
+    }
+    return n;
+}
+
+/**
+ * @brief Scans for the next tab or stop byte with memchr and updates the column for all bytes in front of it
+ *
+ * @param buf The bytes to be scanned
+ * @param len The number of usable bytes in buf
+ * @param x The current column, updated to the column of the returned position
+ * @param utf8 Whether columns are counted in UTF-8 code points
+ * @param stop A byte that ends the run like a tab, '\t' when only tabs matter
+ * @return size_t The length of the run at the start of buf without tabs and stop bytes (len if there is none)
+ */
+static size_t scan_scalar(const char *buf, size_t len, size_t *x, int utf8, char stop) {
+    const char *run_end = memchr(buf, stop, len);
+    if (run_end == NULL) {
+        run_end = buf + len;
+    }
+    if (stop != '\t') {
+        const char *tab = memchr(buf, '\t', run_end - buf);
+        run_end = tab == NULL ? run_end : tab;
+    }
+
+    /* The column only depends on the bytes after the last newline of the run */
+    const char *line = buf, *nl;
+    while ((nl = memchr(line, '\n', run_end - line)) != NULL) {
+        line = nl + 1;
+    }
+    *x = (line == buf ? *x : 0) + count_columns(line, run_end - line, utf8);
+    return run_end - buf;
+}
+
+#ifdef HAVE_SIMD
+/**
+ * @brief Advances the column over a classified vector of bytes
+ * @details Only the plain bytes after the last newline count, so the new column is a popcount
+ *
+ * @param x The column before the vector
+ * @param plain Mask of the plain bytes (neither tab, newline nor UTF-8 continuation) that are part of the run
+ * @param nl Mask of the newlines that are part of the run
+ * @return size_t The column after the vector
+ */
+static inline size_t advance_column(size_t x, uint32_t plain, uint32_t nl) {
+    if (nl != 0) {
+        int last = 31 - __builtin_clz(nl);
+        plain &= (uint32_t)~((2ULL << last) - 1);
+        x = 0;
+    }
+    return x + __builtin_popcount(plain);
+}
+
+/**
+ * @brief Like scan_scalar, but classifies 16 bytes at a time into tab (or stop), newline and plain masks
+ * @details In UTF-8 mode, vectors that are not pure ASCII additionally get their continuation bytes
+ * removed from the plain mask. These are the bytes 0x80-0xBF, i.e. the signed bytes below -64.
+ */
+__attribute__((target("sse2"))) static size_t scan_sse2(const char *buf, size_t len, size_t *x, int utf8, char stop) {
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i end = _mm_set1_epi8(stop);
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cont = _mm_set1_epi8(-64);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        uint32_t tabs = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, tab));
+        if (stop != '\t') {
+            tabs |= (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, end));
+        }
+        uint32_t nls = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        uint32_t plain = 0xFFFF & ~nls;
+        if (utf8 && _mm_movemask_epi8(v) != 0) {
+            plain &= ~(uint32_t)_mm_movemask_epi8(_mm_cmplt_epi8(v, cont));
+        }
+        if (tabs != 0) {
+            uint32_t run = (tabs & -tabs) - 1;
+            *x = advance_column(*x, run & plain, run & nls);
+            return i + __builtin_ctz(tabs);
+        }
+        *x = advance_column(*x, plain, nls);
+    }
+    return i + scan_scalar(buf + i, len - i, x, utf8, stop);
+}
+
+/**
+ * @brief Like scan_sse2, but with 32 bytes at a time
+ */
+__attribute__((target("avx2"))) static size_t scan_avx2(const char *buf, size_t len, size_t *x, int utf8, char stop) {
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i end = _mm256_set1_epi8(stop);
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cont = _mm256_set1_epi8(-64);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        uint32_t tabs = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, tab));
+        if (stop != '\t') {
+            tabs |= (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, end));
+        }
+        uint32_t nls = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        uint32_t plain = ~nls;
+        if (utf8 && _mm256_movemask_epi8(v) != 0) {
+            plain &= ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(cont, v));
+        }
+        if (tabs != 0) {
+            uint32_t run = (tabs & -tabs) - 1;
+            *x = advance_column(*x, run & plain, run & nls);
+            return i + __builtin_ctz(tabs);
+        }
+        *x = advance_column(*x, plain, nls);
+    }
+    return i + scan_sse2(buf + i, len - i, x, utf8, stop);
+}
+#endif
+
+/* The scanner used by expand_chunk, chosen at runtime by select_scanner */
+static size_t (*scan_run)(const char *buf, size_t len, size_t *x, int utf8, char stop) = scan_scalar;
+
+/* Makes sure select_scanner runs exactly once */
+static pthread_once_t scanner_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Picks the widest scanner the CPU supports
+ */
+static void select_scanner(void) {
+#ifdef HAVE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_run = scan_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_run = scan_sse2;
+    }
+#endif
+}
+
+/**
+ * @brief Counts the lines of len expanded bytes
+ *
+ * @param stats The counters to be updated
+ * @param buf The expanded bytes
+ * @param len The number of expanded bytes
+ */
+static void count_lines(expand_stats_t *stats, const char *buf, size_t len) {
+    const char *end = buf + len;
+    const char *nl;
+    while ((nl = memchr(buf, '\n', end - buf)) != NULL) {
+        size_t line = stats->line + (nl - buf);
+        if (line > stats->longest) {
+            stats->longest = line;
+        }
+        stats->lines++;
+        stats->line = 0;
+        buf = nl + 1;
+    }
+    stats->line += end - buf;
+    stats->bytes_out += len;
+}
+
+/**
+ * @brief Passes expanded bytes to the output callback, counting them if requested
+ *
+ * @param state The state of the stream
+ * @param buf The expanded bytes
+ * @param len The number of expanded bytes
+ * @param out The output callback
+ * @param ctx Passed to out
+ * @return int 0 on success, -1 if out failed
+ */
+static int pass(expand_state_t *state, const char *buf, size_t len, expand_out_t out, void *ctx) {
+    if (state->stats != NULL) {
+        count_lines(state->stats, buf, len);
+    }
+    return out(ctx, buf, len);
+}
+
+/**
+ * @brief Collects len expanded bytes in the state, passing them on once it is full
+ * @details Runs of at least EXPAND_DIRECT_SIZE bytes are not copied but passed to out directly
+ *
+ * @param state The state of the stream
+ * @param buf The expanded bytes
+ * @param len The number of expanded bytes
+ * @param out The output callback
+ * @param ctx Passed to out
+ * @return int 0 on success, -1 if out failed
+ */
+static int emit(expand_state_t *state, const char *buf, size_t len, expand_out_t out, void *ctx) {
+    if (state->len + len > EXPAND_STAGE_SIZE || len >= EXPAND_DIRECT_SIZE) {
+        if (state->len > 0 && pass(state, state->buf, state->len, out, ctx) == -1) {
+            return -1;
+        }
+        state->len = 0;
+        if (len >= EXPAND_DIRECT_SIZE) {
+            return pass(state, buf, len, out, ctx);
+        }
+    }
+    memcpy(state->buf + state->len, buf, len);
+    state->len += len;
+    return 0;
+}
+
+/**
+ * @brief Collects n spaces from the static space buffer
+ *
+ * @param state The state of the stream
+ * @param n The number of spaces
+ * @param out The output callback
+ * @param ctx Passed to out
+ * @return int 0 on success, -1 if out failed
+ */
+static int emit_spaces(expand_state_t *state, size_t n, expand_out_t out, void *ctx) {
+    while (n > SPACES_SIZE) {
+        if (emit(state, spaces, SPACES_SIZE, out, ctx) == -1) {
+            return -1;
+        }
+        n -= SPACES_SIZE;
+    }
+    return emit(state, spaces, n, out, ctx);
+}
+
+int expand_config_init(expand_config_t *config, const char *tabs, int utf8, expand_mode_t mode, const char **err) {
+    memset(config, 0, sizeof(*config));
+    config->utf8 = utf8;
+    config->mode = mode;
+    pthread_once(&scanner_once, select_scanner);
+
+    const char *src = tabs == NULL ? DEFAULT_TABS : tabs;
+    char *list = strdup(src);
+    /* Every stop needs at least two characters, except for the last one */
+    config->stops = malloc((strlen(src) / 2 + 1) * sizeof(size_t));
+    if (list == NULL || config->stops == NULL) {
+        free(list);
+        expand_config_free(config);
+        *err = "malloc failed";
+        errno = ENOMEM;
+        return -1;
+    }
+
+    *err = parse_tabs(config, list);
+    free(list);
+    if (*err != NULL) {
+        expand_config_free(config);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (compile_tabs(config) == -1) {
+        expand_config_free(config);
+        *err = "malloc failed";
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+void expand_config_free(expand_config_t *config) {
+    free(config->stops);
+    free(config->table);
+    config->stops = NULL;
+    config->table = NULL;
+}
+
+void expand_init(expand_state_t *state, const expand_config_t *config) {
+    state->config = config;
+    state->x = 0;
+    state->len = 0;
+    state->stats = NULL;
+    state->pending = 0;
+    state->one_blank = 0;
+    state->prev_blank = 1;
+    state->convert = 1;
+}
+
+/**
+ * @brief Writes the pending spaces of an unexpanded stream in front of a non-blank
+ * @details The first of several spaces that started with a single one at a tab stop becomes a tab
+ *
+ * @param state The state of the stream
+ * @param out The output callback
+ * @param ctx Passed to out
+ * @param tabs Incremented by the number of written tabs
+ * @return int 0 on success, -1 if out failed
+ */
+static int emit_pending(expand_state_t *state, expand_out_t out, void *ctx, size_t *tabs) {
+    size_t n = state->pending;
+    state->pending = 0;
+    if (n > 1 && state->one_blank) {
+        if (emit(state, "\t", 1, out, ctx) == -1) {
+            return -1;
+        }
+        ++*tabs;
+        n--;
+    }
+    state->one_blank = 0;
+    return emit_spaces(state, n, out, ctx);
+}
+
+/**
+ * @brief Handles a blank of an unexpanded stream whose line is still converted
+ *
+ * @param state The state of the stream
+ * @param c The blank, ' ' or '\t'
+ * @param out The output callback
+ * @param ctx Passed to out
+ * @param tabs Incremented by the number of written tabs
+ * @return int 0 on success, -1 if out failed
+ */
+static int unexpand_blank(expand_state_t *state, char c, expand_out_t out, void *ctx, size_t *tabs) {
+    const expand_config_t *config = state->config;
+    size_t x = state->x;
+    size_t last = config->n > 0 ? config->stops[config->n - 1] : 0;
+
+    /* Behind the last stop of a plain list, the rest of the line stays as it is */
+    if (config->repeat == 0 && x >= last) {
+        state->convert = 0;
+        if (emit_pending(state, out, ctx, tabs) == -1) {
+            return -1;
+        }
+        return emit(state, &c, 1, out, ctx);
+    }
+
+    size_t next = x + (x < config->size ? config->table[x] : tab_width_slow(config, x));
+    if (c == ' ') {
+        state->x = x + 1;
+        if (!state->prev_blank || state->x != next) {
+            /* Not yet time for a tab, the space may still become part of one */
+            state->one_blank |= state->x == next;
+            state->pending++;
+            state->prev_blank = 1;
+            return 0;
+        }
+    } else {
+        state->x = next;
+    }
+
+    /* The pending spaces are replaced by the tab, unless a single one came right before the previous stop */
+    int one_blank = state->one_blank;
+    state->pending = 0;
+    state->one_blank = 0;
+    state->prev_blank = 1;
+    *tabs += 1 + one_blank;
+    return emit(state, "\t\t", 1 + one_blank, out, ctx);
+}
+
+/**
+ * @brief Unexpands the next len bytes of the stream, see expand_chunk
+ * @details Lines that are no longer converted are copied up to their newline. With UNEXPAND_ALL, the
+ * bytes between blanks are found by the same scanner as tabs, stopping at spaces as well.
+ */
+static int unexpand_chunk(expand_state_t *state, const char *in, size_t len, expand_out_t out, void *ctx) {
+    const expand_config_t *config = state->config;
+    const char *end = in + len;
+    size_t tabs = 0;
+    while (in < end) {
+        if (!state->convert) {
+            const char *nl = memchr(in, '\n', end - in);
+            const char *run_end = nl == NULL ? end : nl + 1;
+            if (emit(state, in, run_end - in, out, ctx) == -1) {
+                return -1;
+            }
+            in = run_end;
+            if (nl != NULL) {
+                state->x = 0;
+                state->prev_blank = 1;
+                state->convert = 1;
+            }
+            continue;
+        }
+
+        if (*in == ' ' || *in == '\t') {
+            if (unexpand_blank(state, *in, out, ctx, &tabs) == -1) {
+                return -1;
+            }
+            in++;
+            continue;
+        }
+
+        if (state->pending > 0 && emit_pending(state, out, ctx, &tabs) == -1) {
+            return -1;
+        }
+        if (config->mode == UNEXPAND_LEADING) {
+            /* The rest of the line is copied, including this byte */
+            state->convert = *in == '\n';
+            state->prev_blank = 1;
+            state->x = 0;
+            if (state->convert && emit(state, in++, 1, out, ctx) == -1) {
+                return -1;
+            }
+            continue;
+        }
+
+        size_t run = scan_run(in, end - in, &state->x, config->utf8, ' ');
+        if (emit(state, in, run, out, ctx) == -1) {
+            return -1;
+        }
+        state->prev_blank = in[run - 1] == '\n';
+        in += run;
+    }
+
+    if (state->stats != NULL) {
+        state->stats->bytes_in += len;
+        state->stats->tabs += tabs;
+    }
+    return 0;
+}
+
+int expand_chunk(expand_state_t *state, const char *in, size_t len, expand_out_t out, void *ctx) {
+    const expand_config_t *config = state->config;
+    if (config->mode != EXPAND_TABS) {
+        return unexpand_chunk(state, in, len, out, ctx);
+    }
+    const char *end = in + len;
+    size_t tabs = 0;
+    while (in < end) {
+        size_t run = scan_run(in, end - in, &state->x, config->utf8, '\t');
+        if (emit(state, in, run, out, ctx) == -1) {
+            return -1;
+        }
+        in += run;
+
+        if (in == end) {
+            break;
+        }
+
+        size_t x = state->x;
+        size_t width = x < config->size ? config->table[x] : tab_width_slow(config, x);
+        if (emit_spaces(state, width, out, ctx) == -1) {
+            return -1;
+        }
+        state->x += width;
+        in++;
+        tabs++;
+    }
+
+    if (state->stats != NULL) {
+        state->stats->bytes_in += len;
+        state->stats->tabs += tabs;
+    }
+    return 0;
+}
+
+void expand_count(expand_stats_t *stats, const char *buf, size_t len) {
+    stats->bytes_in += len;
+    count_lines(stats, buf, len);
+}
+
+int expand_drain(expand_state_t *state, expand_out_t out, void *ctx) {
+    int ret = state->len > 0 ? pass(state, state->buf, state->len, out, ctx) : 0;
+    state->len = 0;
+    return ret;
+}
+
+int expand_flush(expand_state_t *state, expand_out_t out, void *ctx) {
+    size_t tabs = 0;
+    if (state->pending > 0 && emit_pending(state, out, ctx, &tabs) == -1) {
+        return -1;
+    }
+    if (state->stats != NULL) {
+        state->stats->tabs += tabs;
+    }
+    state->x = 0;
+    state->prev_blank = 1;
+    state->convert = 1;
+    return expand_drain(state, out, ctx);
+}
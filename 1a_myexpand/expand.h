@@ -0,0 +1,168 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stddef.h>
+
+#define EXPAND_STAGE_SIZE 8192  // number of expanded bytes collected before the output callback is called
+#define EXPAND_DIRECT_SIZE 512  // runs of at least this many bytes are passed to the output callback directly
+
+/**
+ * @brief Receives expanded bytes
+ *
+ * @param ctx The context pointer given to expand_chunk or expand_flush
+ * @param buf The expanded bytes, only valid during the call
+ * @param len The number of expanded bytes
+ * @return int 0 on success, -1 to make expand_chunk or expand_flush fail
+ */
+typedef int (*expand_out_t)(void *ctx, const char *buf, size_t len);
+
+/**
+ * @brief The direction of the transformation
+ */
+typedef enum {
+    EXPAND_TABS,       // tabs are replaced by spaces
+    UNEXPAND_LEADING,  // blanks at the start of a line are replaced by tabs where possible
+    UNEXPAND_ALL       // all runs of blanks are replaced by tabs where possible
+} expand_mode_t;
+
+/**
+ * @brief Compiled tab stops and options, may be shared by any number of expand_state_t (and threads)
+ * @details A list of explicit stops, followed by stops every repeat columns. Both parts may be empty.
+ * @param stops Explicit tab stops in ascending order
+ * @param n The number of explicit tab stops
+ * @param repeat Distance of the stops behind the explicit ones, 0 if a tab there becomes a single space
+ * @param relative Whether these are counted from the last explicit stop (+N) or from column 0 (/N)
+ * @param table Number of spaces a tab at column x expands to, for every x < size
+ * @param size The number of entries in table
+ * @param utf8 Whether columns are counted in UTF-8 code points instead of bytes
+ * @param mode Whether tabs are expanded or blanks are unexpanded
+ */
+typedef struct {
+    size_t *stops;
+    size_t n;
+    size_t repeat;
+    int relative;
+    size_t *table;
+    size_t size;
+    int utf8;
+    expand_mode_t mode;
+} expand_config_t;
+
+/**
+ * @brief Counters of one or more streams, updated per block of output and not per byte
+ * @param bytes_in The number of input bytes
+ * @param bytes_out The number of expanded bytes
+ * @param tabs The number of expanded tabs
+ * @param lines The number of newlines
+ * @param longest The length of the longest complete expanded line in bytes, without its newline
+ * @param line The length of the current expanded line, not included in longest yet
+ */
+typedef struct {
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long tabs;
+    unsigned long long lines;
+    size_t longest;
+    size_t line;
+} expand_stats_t;
+
+/**
+ * @brief State of a single stream that is expanded piece by piece
+ * @param config The configuration used for the stream
+ * @param x The current column, carried over from one expand_chunk to the next
+ * @param len The number of usable bytes in buf
+ * @param buf Expanded bytes that have not been passed to the output callback yet
+ * @param stats Counters to be updated, NULL after expand_init; may be set by the caller
+ * @param pending Unexpanding: the number of spaces that have not been written yet
+ * @param one_blank Unexpanding: whether the first pending space reached a tab stop on its own
+ * @param prev_blank Unexpanding: whether the previous byte was a blank (or the line just started)
+ * @param convert Unexpanding: whether blanks on the current line are still converted
+ */
+typedef struct {
+    const expand_config_t *config;
+    size_t x;
+    size_t len;
+    char buf[EXPAND_STAGE_SIZE];
+    expand_stats_t *stats;
+    size_t pending;
+    int one_blank;
+    int prev_blank;
+    int convert;
+} expand_state_t;
+
+/**
+ * @brief Parses a tab stop list and compiles it into config
+ * @details Accepts a single tab size N, or a list of ascending tab stops separated by commas or blanks,
+ * whose last element may be prefixed with / (stops at multiples of N) or + (stops every N columns after
+ * the previous stop). Like GNU expand, a tab behind the last stop of a plain list becomes a single space.
+ *
+ * @param config The configuration to be initialized
+ * @param tabs The tab stop list, or NULL for a tab stop every 8 columns
+ * @param utf8 Whether columns are counted in UTF-8 code points instead of bytes
+ * @param mode Whether tabs are expanded or blanks are unexpanded
+ * @param err Set to a description of the problem on failure
+ * @return int 0 on success, -1 on failure with errno set to EINVAL (invalid list) or ENOMEM
+ */
+int expand_config_init(expand_config_t *config, const char *tabs, int utf8, expand_mode_t mode, const char **err);
+
+/**
+ * @brief Frees the memory held by a configuration
+ *
+ * @param config The configuration initialized by expand_config_init
+ */
+void expand_config_free(expand_config_t *config);
+
+/**
+ * @brief Prepares state for a new stream at column 0
+ *
+ * @param state The state to be initialized
+ * @param config The configuration, must outlive state
+ */
+void expand_init(expand_state_t *state, const expand_config_t *config);
+
+/**
+ * @brief Expands (or unexpands) the next len bytes of the stream
+ * @details Expanded bytes are collected in the state and passed to out in large pieces.
+ * Lines may be split across calls arbitrarily. Unexpanding follows GNU unexpand: a run of blanks
+ * that reaches a tab stop becomes a tab, except for a single space in front of a non-blank.
+ *
+ * @param state The state of the stream
+ * @param in The input bytes
+ * @param len The number of input bytes
+ * @param out The output callback
+ * @param ctx Passed to out
+ * @return int 0 on success, -1 if out failed
+ */
+int expand_chunk(expand_state_t *state, const char *in, size_t len, expand_out_t out, void *ctx);
+
+/**
+ * @brief Passes all collected bytes to out without ending the stream
+ * @details Used when the output has to be up to date before the rest of the stream is known
+ *
+ * @param state The state of the stream
+ * @param out The output callback
+ * @param ctx Passed to out
+ * @return int 0 on success, -1 if out failed
+ */
+int expand_drain(expand_state_t *state, expand_out_t out, void *ctx);
+
+/**
+ * @brief Passes all collected (and pending) bytes to out and ends the stream, so that the next one starts at column 0
+ *
+ * @param state The state of the stream
+ * @param out The output callback
+ * @param ctx Passed to out
+ * @return int 0 on success, -1 if out failed
+ */
+int expand_flush(expand_state_t *state, expand_out_t out, void *ctx);
+
+/**
+ * @brief Counts len bytes that reach the output unchanged, without going through expand_chunk
+ *
+ * @param stats The counters to be updated
+ * @param buf The bytes
+ * @param len The number of bytes
+ */
+void expand_count(expand_stats_t *stats, const char *buf, size_t len);
+
+#endif
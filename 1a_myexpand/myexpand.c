@@ -1,22 +1,176 @@
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "cache.h"
+#include "expand.h"
+#include "uring.h"
+
 #define NO_MSG ""
+#define STATS_OPTION 256  // getopt_long value of --stats, outside of the range of the short options
+#define BLOCK_SIZE (1 << 17)  // number of bytes read from the input at once
+#define CHUNK_SIZE (1 << 22)  // minimum number of bytes expanded by one thread in -j mode
+#define PWRITE_SIZE (1 << 20) // size of the buffer of a thread writing with pwrite
+#define URING_ENTRIES 4       // number of submission queue entries of the io_uring of -A
+#define PASSTHROUGH_SIZE (1 << 16) // minimum length of a tab-free span that is copied by the kernel
+#define FOLLOW_PENDING_MAX (1 << 20) // incomplete lines of -f longer than this are written without waiting for their end
+#define BATCH_WINDOW 4        // number of files per thread of -P that may be expanded ahead of the output
 
 typedef struct {
     char *bin;      // program name
-    long tabstops;  // value of the -t option
+    char *t;        // value of the -t option
     u_int8_t ts;    // number of occurences of the -t option
     char *o;        // value of the -o option
     u_int8_t os;    // number of occurences of the -o option
+    long jobs;      // value of the -j option
+    u_int8_t js;    // number of occurences of the -j option
+    int utf8;       // whether columns are counted in UTF-8 code points instead of bytes (-u)
+    long pool;      // value of the -P option
+    u_int8_t ps;    // number of occurences of the -P option
+    int in_place;   // whether the files are replaced by their expansion (-i)
+    int recursive;  // whether directories are searched for files to be replaced (-r)
+    int uring;      // whether streamed inputs are read and written with io_uring (-A)
+    int follow;     // whether appended bytes are expanded until interrupted (-f)
+    int stats;      // whether statistics are printed per file and in total (--stats)
+    expand_mode_t mode;  // whether tabs are expanded or leading (-U) or all (-a) blanks are unexpanded
+    char *c;        // value of the -c option
+    u_int8_t cs;    // number of occurences of the -c option
     FILE *outfile;  // file to be written to
+    int outfd;      // descriptor of -o without O_APPEND if it is a regular file, otherwise -1
 } args_t;
 
+/**
+ * @brief The kinds of sink_t
+ */
+typedef enum {
+    SINK_BUFFER,  // appends to a growable memory buffer
+    SINK_FILE,    // writes to file with stdio
+    SINK_COUNT,   // only counts the bytes in len
+    SINK_PWRITE   // buffers up to cap bytes and writes them to fd at off
+} sink_kind_t;
+
+/**
+ * @brief Destination of expanded bytes
+ */
+typedef struct {
+    sink_kind_t kind;  // determines which of the other members are used
+    FILE *file;        // file to be written to
+    int fd;            // descriptor to be written to with pwrite
+    off_t off;         // position of buf inside fd
+    char *buf;         // buffer to be appended to
+    size_t len;        // number of usable bytes in buf (or counted bytes)
+    size_t cap;        // allocated size of buf
+    expand_stats_t *stats;  // counters of the file that is expanded into the sink, NULL without --stats
+} sink_t;
+
+/**
+ * @brief How long tab-free spans of mapped inputs reach the output without passing through user space
+ */
+typedef enum {
+    PASS_NONE,     // not possible for the output (or the kernel refused), the spans are written as usual
+    PASS_SPLICE,   // the output is a pipe, spans are moved with splice
+    PASS_COPY      // the output is a regular file, spans are copied with copy_file_range
+} passthrough_t;
+
+/**
+ * @brief A newline-aligned part of a mapped file that is expanded by its own thread
+ */
+typedef struct {
+    const char *in;  // start of the chunk inside the mapping
+    size_t len;      // length of the chunk
+    sink_t out;      // private buffer receiving (or counting) the expanded chunk
+    expand_stats_t stats;  // counters of the chunk (only with --stats)
+} chunk_t;
+
+/**
+ * @brief Shared state of the threads of expand_positioned
+ */
+typedef struct {
+    chunk_t *chunks;       // all chunks of the mapped file
+    int fd;                // descriptor of the mapped file
+    size_t n;              // number of chunks
+    off_t *offsets;        // output position of each chunk, NULL during the counting pass
+    size_t next;           // index of the next chunk to be taken by a thread
+    pthread_mutex_t lock;  // protects next
+} job_t;
+
+/**
+ * @brief Shared state of the threads of expand_batch
+ * @details Results are kept in a ring of window slots, so that at most window files are
+ * expanded ahead of the one that is written next
+ */
+typedef struct {
+    char **paths;          // the input files
+    size_t n;              // number of input files
+    sink_t *results;       // expanded files, file i is in slot i % window
+    int *done;             // whether the slot holds a finished result
+    size_t window;         // number of slots
+    size_t next;           // index of the next file to be taken by a thread
+    size_t emitted;        // number of files that have been written to the output
+    cache_entry_t *entries;  // new cache entries, one per file (only with -c)
+    pthread_mutex_t lock;  // protects all members above
+    pthread_cond_t cond;   // signals finished results and free slots
+} batch_t;
+
+/**
+ * @brief A file that is followed with -f
+ */
+typedef struct {
+    const char *path;      // path of the file
+    int fd;                // descriptor of the file
+    int wd;                // inotify watch descriptor of the file
+    off_t off;             // number of bytes read so far
+    expand_state_t state;  // column of the last line, kept across wakeups
+    sink_t pending;        // expanded bytes that do not form a complete line yet
+    expand_stats_t stats;  // counters of the file (only with --stats)
+} follow_t;
+
+/**
+ * @brief A growable list of paths
+ */
+typedef struct {
+    char **paths;  // the paths, allocated with malloc
+    size_t n;      // number of paths
+    size_t cap;    // allocated size of paths
+} paths_t;
+
 /* Global configuration */
-args_t args = {.tabstops = 8};
+args_t args = {.jobs = 1, .pool = 1, .outfd = -1};
+
+/* Tab stops and options compiled from the arguments */
+static expand_config_t config;
+
+/* Sink of the output file */
+static sink_t output;
+
+/* How tab-free spans reach the output sink, see expand_spliced */
+static passthrough_t passthrough;
+
+/* Counters of all files and when the run started (only with --stats) */
+static expand_stats_t total;
+static struct timespec run_start;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Set by SIGINT and SIGTERM to end -f */
+static volatile sig_atomic_t quit;
+
+/* Entries of the cache file of -c */
+static cache_t cache;
+
+/* Status of the cache file of -c, so that it is not mistaken for an input file */
+static struct stat cache_st;
 
 /**
  * @brief Typical usage method
@@ -25,7 +179,7 @@ static void usage(char *msg) {
     if (strcmp(msg, NO_MSG) != 0) {
         fprintf(stderr, "Error: %s\n", msg);
     }
-    fprintf(stderr, "Usage: %s [-t tabstop] [-o outfile] [file...]\n", args.bin);
+    fprintf(stderr, "Usage: %s [-t tabstop[,tabstop...][,/repeat|,+repeat]] [-o outfile] [-j jobs | -P threads] [-i | -r [-c cachefile] | -f] [-U [-a]] [-u] [-A] [--stats] [file...]\n", args.bin);
     exit(EXIT_FAILURE);
 }
 
@@ -50,8 +204,14 @@ static void handle_args(int argc, char **argv) {
     args.bin = argv[0];
     args.outfile = stdout;
 
-    char cur;
-    while ((cur = getopt(argc, argv, "t:o:")) != -1) {
+    static const struct option long_options[] = {
+        {"stats", no_argument, NULL, STATS_OPTION},
+        {NULL, 0, NULL, 0},
+    };
+
+    int cur;
+    char *end;
+    while ((cur = getopt_long(argc, argv, "t:o:j:uP:irc:AfUa", long_options, NULL)) != -1) {
         switch (cur) {
             case 't':
                 args.ts++;
@@ -59,11 +219,7 @@ static void handle_args(int argc, char **argv) {
                     usage("-t was provided too often");
                 }
 
-                char *end;
-                args.tabstops = strtol(optarg, &end, 10);
-                if (*end != '\0' || args.tabstops < 0) {
-                    usage("Argument for option -t is not an integer >= 0");
-                }
+                args.t = optarg;
                 break;
             case 'o':
                 args.os++;
@@ -72,63 +228,1424 @@ static void handle_args(int argc, char **argv) {
                 }
                 args.o = optarg;
                 break;
+            case 'j':
+                args.js++;
+                if (args.js > 1) {
+                    usage("-j was provided too often");
+                }
+
+                args.jobs = strtol(optarg, &end, 10);
+                if (*end != '\0' || args.jobs < 1) {
+                    usage("Argument for option -j is not an integer >= 1");
+                }
+                break;
+            case 'u':
+                args.utf8 = 1;
+                break;
+            case 'P':
+                args.ps++;
+                if (args.ps > 1) {
+                    usage("-P was provided too often");
+                }
+
+                args.pool = strtol(optarg, &end, 10);
+                if (*end != '\0' || args.pool < 1) {
+                    usage("Argument for option -P is not an integer >= 1");
+                }
+                break;
+            case 'i':
+                args.in_place = 1;
+                break;
+            case 'r':
+                args.recursive = 1;
+                args.in_place = 1;
+                break;
+            case 'A':
+                args.uring = 1;
+                break;
+            case 'f':
+                args.follow = 1;
+                break;
+            case 'U':
+                if (args.mode == EXPAND_TABS) {
+                    args.mode = UNEXPAND_LEADING;
+                }
+                break;
+            case 'a':
+                args.mode = UNEXPAND_ALL;
+                break;
+            case STATS_OPTION:
+                args.stats = 1;
+                break;
+            case 'c':
+                args.cs++;
+                if (args.cs > 1) {
+                    usage("-c was provided too often");
+                }
+                args.c = optarg;
+                break;
             default:
                 usage(NO_MSG);
         }
     }
 
+    const char *err;
+    if (expand_config_init(&config, args.t, args.utf8, args.mode, &err) == -1) {
+        if (errno == EINVAL) {
+            usage((char *)err);
+        }
+        error_exit((char *)err);
+    }
+
+    if (args.js == 1 && (args.ps == 1 || args.in_place)) {
+        usage("-j cannot be combined with -P or -i");
+    }
+    if (args.in_place && (args.os == 1 || optind == argc)) {
+        usage("-i needs input files and no -o");
+    }
+    /* -f reads every file with plain reads as it grows, so -A would be silently ignored */
+    if (args.follow && (args.js == 1 || args.ps == 1 || args.in_place || args.uring)) {
+        usage("-f cannot be combined with -j, -P, -i or -A");
+    }
+    if (args.follow && optind == argc) {
+        usage("-f needs input files");
+    }
+    if (args.cs == 1 && !args.in_place) {
+        usage("-c needs -i or -r");
+    }
+
     if (args.os == 1) {
         args.outfile = fopen(args.o, "a");
         if (args.outfile == NULL) {
             error_exit(NO_MSG);
         }
+
+        /* pwrite ignores the offset of descriptors opened with O_APPEND, so a second one is needed */
+        struct stat st;
+        if (fstat(fileno(args.outfile), &st) == 0 && S_ISREG(st.st_mode)) {
+            args.outfd = open(args.o, O_WRONLY);
+        }
+    }
+    output.kind = SINK_FILE;
+    output.file = args.outfile;
+
+    /* Unexpanding changes spaces, so no span can be passed through unchanged */
+    struct stat st;
+    if (args.mode == EXPAND_TABS && fstat(fileno(args.outfile), &st) == 0) {
+        passthrough = S_ISFIFO(st.st_mode) ? PASS_SPLICE : S_ISREG(st.st_mode) ? PASS_COPY : PASS_NONE;
+    }
+}
+
+/**
+ * @brief Writes all len bytes of buf to fd at off, retrying on short writes
+ *
+ * @param fd The file descriptor to be written to
+ * @param buf The bytes to be written
+ * @param len The number of bytes to be written
+ * @param off The position inside fd
+ */
+static void pwrite_all(int fd, const char *buf, size_t len, off_t off) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, off);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_exit("pwrite failed");
+        }
+        buf += n;
+        len -= n;
+        off += n;
+    }
+}
+
+/**
+ * @brief Writes the buffered bytes of a SINK_PWRITE sink
+ *
+ * @param out The sink to be flushed
+ */
+static void flush_sink(sink_t *out) {
+    pwrite_all(out->fd, out->buf, out->len, out->off);
+    out->off += out->len;
+    out->len = 0;
+}
+
+/**
+ * @brief Writes len bytes to a sink
+ *
+ * @param out The sink to be written to
+ * @param buf The bytes to be written
+ * @param len The number of bytes to be written
+ */
+static void write_out(sink_t *out, const char *buf, size_t len) {
+    switch (out->kind) {
+        case SINK_FILE:
+            if (fwrite(buf, 1, len, out->file) != len) {
+                error_exit("fwrite failed");
+            }
+            return;
+        case SINK_COUNT:
+            out->len += len;
+            return;
+        case SINK_PWRITE:
+            if (out->len + len > out->cap) {
+                flush_sink(out);
+            }
+            if (len > out->cap) {
+                pwrite_all(out->fd, buf, len, out->off);
+                out->off += len;
+                return;
+            }
+            break;
+        case SINK_BUFFER:
+            if (out->len + len > out->cap) {
+                size_t cap = out->cap == 0 ? BLOCK_SIZE : out->cap;
+                while (cap < out->len + len) {
+                    cap *= 2;
+                }
+                char *buf = realloc(out->buf, cap);
+                if (buf == NULL) {
+                    error_exit("realloc failed");
+                }
+                out->buf = buf;
+                out->cap = cap;
+            }
+            break;
+    }
+    memcpy(out->buf + out->len, buf, len);
+    out->len += len;
+}
+
+/**
+ * @brief Output callback of the expansion library writing to a sink_t
+ *
+ * @param ctx The sink_t to be written to
+ * @param buf The expanded bytes
+ * @param len The number of expanded bytes
+ * @return int Always 0, errors terminate the program
+ */
+static int write_sink(void *ctx, const char *buf, size_t len) {
+    write_out(ctx, buf, len);
+    return 0;
+}
+
+/**
+ * @brief Adds the counters of a file or chunk to those of another one
+ *
+ * @param to The counters to be added to
+ * @param from The counters of a finished file or chunk
+ */
+static void add_stats(expand_stats_t *to, const expand_stats_t *from) {
+    size_t longest = from->longest > from->line ? from->longest : from->line;
+    to->bytes_in += from->bytes_in;
+    to->bytes_out += from->bytes_out;
+    to->tabs += from->tabs;
+    to->lines += from->lines;
+    if (longest > to->longest) {
+        to->longest = longest;
+    }
+}
+
+/**
+ * @brief Prints the counters of a file, or the total ones, to stderr
+ *
+ * @param name The name of the file
+ * @param stats The counters
+ * @param start When the expansion started
+ */
+static void print_stats(const char *name, const expand_stats_t *stats, const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+    size_t longest = stats->longest > stats->line ? stats->longest : stats->line;
+    double ratio = stats->bytes_in > 0 ? (double)stats->bytes_out / stats->bytes_in : 1;
+
+    fprintf(stderr, "%s: %llu bytes in, %llu bytes out (%.2fx), %llu tabs, %llu lines, longest line %zu, %.3f s, %.1f MB/s\n",
+            name, stats->bytes_in, stats->bytes_out, ratio, stats->tabs, stats->lines, longest, seconds,
+            seconds > 0 ? stats->bytes_in / seconds / 1e6 : 0);
+}
+
+/**
+ * @brief Starts counting the expansion of a file into a sink (only with --stats)
+ *
+ * @param out The sink receiving the expanded file
+ * @param stats The counters of the file
+ * @param start Receives the start time
+ */
+static void begin_stats(sink_t *out, expand_stats_t *stats, struct timespec *start) {
+    if (!args.stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    out->stats = stats;
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+/**
+ * @brief Prints the counters of a file that has been expanded into a sink and adds them to the total ones
+ *
+ * @param out The sink receiving the expanded file
+ * @param name The name of the file
+ * @param start When the expansion started
+ */
+static void end_stats(sink_t *out, const char *name, const struct timespec *start) {
+    if (!args.stats) {
+        return;
+    }
+    print_stats(name, out->stats, start);
+    pthread_mutex_lock(&stats_lock);
+    add_stats(&total, out->stats);
+    pthread_mutex_unlock(&stats_lock);
+    out->stats = NULL;
+}
+
+/**
+ * @brief Expands len bytes that form a whole stream, starting at column 0
+ *
+ * @param out The sink receiving the expanded bytes
+ * @param in The bytes to be expanded
+ * @param len The number of bytes
+ */
+static void expand_all(sink_t *out, const char *in, size_t len) {
+    expand_state_t state;
+    expand_init(&state, &config);
+    state.stats = out->stats;
+    expand_chunk(&state, in, len, write_sink, out);
+    expand_flush(&state, write_sink, out);
+}
+
+/**
+ * @brief Copies len bytes of the input file at in_off to out_fd without passing them through user space
+ *
+ * @param fd The file descriptor of the input file
+ * @param in_off The position inside fd
+ * @param out_fd The file descriptor to be written to
+ * @param out_off The position inside out_fd, advanced by the copied bytes, NULL for its current position
+ * @param len The number of bytes
+ * @param pipe Whether out_fd is a pipe, which needs splice instead of copy_file_range
+ * @return size_t The number of copied bytes, less than len if the kernel refused to copy the rest
+ */
+static size_t copy_span(int fd, off_t in_off, int out_fd, off_t *out_off, size_t len, int pipe) {
+    size_t copied = 0;
+    while (copied < len) {
+        ssize_t n = pipe ? splice(fd, &in_off, out_fd, NULL, len - copied, 0)
+                         : copy_file_range(fd, &in_off, out_fd, out_off, len - copied, 0);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        copied += n;
+    }
+    return copied;
+}
+
+/**
+ * @brief Writes a tab-free span of a mapped input file to the output file, inside the kernel if possible
+ *
+ * @param fd The file descriptor of the input file
+ * @param map The mapped input file
+ * @param off The start of the span
+ * @param len The length of the span
+ */
+static void pass_through(int fd, const char *map, off_t off, size_t len) {
+    if (output.stats != NULL) {
+        expand_count(output.stats, map + off, len);
+    }
+    if (fflush(args.outfile) == EOF) {
+        error_exit("fflush failed");
+    }
+
+    /* -o is opened with O_APPEND, which copy_file_range refuses, so its end is written through outfd */
+    size_t copied;
+    if (args.outfd != -1) {
+        off_t end = lseek(args.outfd, 0, SEEK_END);
+        copied = end == -1 ? 0 : copy_span(fd, off, args.outfd, &end, len, 0);
+    } else {
+        copied = copy_span(fd, off, fileno(args.outfile), NULL, len, passthrough == PASS_SPLICE);
+    }
+    if (copied < len) {
+        passthrough = PASS_NONE;
+        write_out(&output, map + off + copied, len - copied);
+    }
+}
+
+/**
+ * @brief Expands a mapped file into the output file, letting the kernel copy long tab-free spans
+ * @details A span can only be passed through if it ends with a newline or the file, because the
+ * column after it has to be known
+ *
+ * @param fd The file descriptor of the input file
+ * @param map The mapped input file
+ * @param size The size of the mapped file
+ */
+static void expand_spliced(int fd, const char *map, size_t size) {
+    expand_state_t state;
+    expand_init(&state, &config);
+    state.stats = output.stats;
+
+    size_t pos = 0;
+    while (pos < size) {
+        const char *tab = memchr(map + pos, '\t', size - pos);
+        size_t end = size;
+        if (tab != NULL) {
+            const char *nl = memrchr(map + pos, '\n', tab - (map + pos));
+            end = nl == NULL ? pos : (size_t)(nl + 1 - map);
+        }
+
+        if (end - pos >= PASSTHROUGH_SIZE && passthrough != PASS_NONE) {
+            expand_flush(&state, write_sink, &output);
+            pass_through(fd, map, pos, end - pos);
+            pos = end;
+        } else {
+            /* Expanding at least PASSTHROUGH_SIZE bytes at once keeps tab-heavy files from costing a memchr per tab */
+            size_t next = tab == NULL ? size : (size_t)(tab + 1 - map);
+            if (next < pos + PASSTHROUGH_SIZE) {
+                next = pos + PASSTHROUGH_SIZE < size ? pos + PASSTHROUGH_SIZE : size;
+            }
+            expand_chunk(&state, map + pos, next - pos, write_sink, &output);
+            pos = next;
+        }
+    }
+    expand_flush(&state, write_sink, &output);
+}
+
+/**
+ * @brief The completions of the reads and writes of expand_uring, indexed by their tag
+ * @param res The result of the last completion
+ * @param done Whether a completion has arrived and was not consumed yet
+ */
+typedef struct {
+    int res[2];
+    int done[2];
+} completions_t;
+
+/**
+ * @brief Waits for the completion with the given tag, remembering those of other tags that arrive first
+ *
+ * @param ring The ring
+ * @param c The completions seen so far
+ * @param tag The tag to be waited for
+ * @return int The result of the completion
+ */
+static int uring_await(uring_t *ring, completions_t *c, unsigned long long tag) {
+    while (!c->done[tag]) {
+        unsigned long long done;
+        int res;
+        if (uring_wait(ring, &done, &res) == -1) {
+            error_exit("io_uring_enter failed");
+        }
+        c->done[done] = 1;
+        c->res[done] = res;
+    }
+    c->done[tag] = 0;
+    return c->res[tag];
+}
+
+/**
+ * @brief Waits until a write of out has completed, resubmitting the rest after short writes
+ *
+ * @param ring The ring
+ * @param c The completions seen so far
+ * @param out The sink that is being written
+ * @param tag The tag of the write
+ */
+static void uring_finish_write(uring_t *ring, completions_t *c, sink_t *out, unsigned long long tag) {
+    size_t written = 0;
+    while (written < out->len) {
+        int res = uring_await(ring, c, tag);
+        if (res < 0) {
+            errno = -res;
+            error_exit("write failed");
+        }
+        written += res;
+        if (written < out->len) {
+            uring_write(ring, fileno(args.outfile), out->buf + written, out->len - written, tag);
+        }
     }
+    out->len = 0;
+}
+
+/**
+ * @brief Performs the expansion algorithm on a streamed input with io_uring
+ * @details Two input and two output buffers are used: while block k is expanded, block k+1 is
+ * already being read and the expansion of block k-1 is still being written
+ *
+ * @param fd The file descriptor of the input
+ * @return int 0 on success, -1 if io_uring is not available and nothing has been read
+ */
+static int expand_uring(int fd) {
+    enum { TAG_READ, TAG_WRITE };
+    uring_t ring;
+    if (uring_init(&ring, URING_ENTRIES) == -1) {
+        return -1;
+    }
+    if (fflush(args.outfile) == EOF) {
+        error_exit("fflush failed");
+    }
+
+    char *in[2] = {malloc(BLOCK_SIZE), malloc(BLOCK_SIZE)};
+    sink_t out[2] = {{.kind = SINK_BUFFER}, {.kind = SINK_BUFFER}};
+    if (in[0] == NULL || in[1] == NULL) {
+        error_exit("malloc failed");
+    }
+    expand_state_t state;
+    expand_init(&state, &config);
+    state.stats = output.stats;
+    completions_t c = {.done = {0, 0}};
+
+    int cur = 0, first = 1, writing = 0;
+    uring_read(&ring, fd, in[cur], BLOCK_SIZE, TAG_READ);
+    for (;;) {
+        int res = uring_await(&ring, &c, TAG_READ);
+        if (res < 0) {
+            /* Old kernels do not know IORING_OP_READ, so they can still fall back */
+            if (first && res == -EINVAL) {
+                uring_exit(&ring);
+                free(in[0]);
+                free(in[1]);
+                return -1;
+            }
+            errno = -res;
+            error_exit("read failed");
+        }
+        first = 0;
+        if (res == 0) {
+            break;
+        }
+
+        uring_read(&ring, fd, in[!cur], BLOCK_SIZE, TAG_READ);
+        expand_chunk(&state, in[cur], res, write_sink, &out[cur]);
+
+        if (writing) {
+            uring_finish_write(&ring, &c, &out[!cur], TAG_WRITE);
+        }
+        writing = out[cur].len > 0;
+        if (writing) {
+            uring_write(&ring, fileno(args.outfile), out[cur].buf, out[cur].len, TAG_WRITE);
+        }
+        cur = !cur;
+    }
+
+    if (writing) {
+        uring_finish_write(&ring, &c, &out[!cur], TAG_WRITE);
+    }
+    expand_flush(&state, write_sink, &out[cur]);
+    if (out[cur].len > 0) {
+        uring_write(&ring, fileno(args.outfile), out[cur].buf, out[cur].len, TAG_WRITE);
+        uring_finish_write(&ring, &c, &out[cur], TAG_WRITE);
+    }
+
+    uring_exit(&ring);
+    for (int i = 0; i < 2; i++) {
+        free(in[i]);
+        free(out[i].buf);
+    }
+    return 0;
 }
 
 /**
  * @brief Performs the expansion algorithm on the given input file
+ * @details With -A, the input is streamed through io_uring if possible
  *
+ * @param out The sink receiving the expanded file
  * @param in The input file to be read from
  */
-static void expand(FILE *in) {
+static void expand(sink_t *out, FILE *in) {
     if (in == NULL) {
         error_exit(NO_MSG);
     }
+    if (args.uring && out == &output && expand_uring(fileno(in)) == 0) {
+        return;
+    }
+
+    char block[BLOCK_SIZE];
+    expand_state_t state;
+    expand_init(&state, &config);
+    state.stats = out->stats;
+
+    size_t len;
+    while ((len = fread(block, 1, BLOCK_SIZE, in)) > 0) {
+        expand_chunk(&state, block, len, write_sink, out);
+    }
+    if (ferror(in)) {
+        error_exit("fread failed");
+    }
+    expand_flush(&state, write_sink, out);
+}
+
+/**
+ * @brief Thread routine that expands a chunk_t into its private buffer
+ *
+ * @param arg The chunk_t to be expanded
+ * @return void* Always NULL
+ */
+static void *expand_chunk_thread(void *arg) {
+    chunk_t *c = arg;
+    c->out.len = 0;
+    expand_all(&c->out, c->in, c->len);
+    return NULL;
+}
+
+/**
+ * @brief Finds the end of the chunk starting at start
+ * @details A chunk ends right after the first newline that follows CHUNK_SIZE bytes,
+ * so that every chunk starts at column 0
+ *
+ * @param map The mapped file
+ * @param size The size of the mapped file
+ * @param start The offset of the chunk
+ * @return size_t The offset right behind the chunk
+ */
+static size_t chunk_end(const char *map, size_t size, size_t start) {
+    if (size - start <= CHUNK_SIZE) {
+        return size;
+    }
+    const char *nl = memchr(map + start + CHUNK_SIZE, '\n', size - start - CHUNK_SIZE);
+    return nl == NULL ? size : (size_t)(nl - map) + 1;
+}
+
+/**
+ * @brief Expands a mapped file with args.jobs threads
+ * @details The file is processed in rounds of up to args.jobs chunks. Every round's chunks are
+ * expanded concurrently and then written to the output file in their original order.
+ *
+ * @param map The mapped file
+ * @param size The size of the mapped file
+ */
+static void expand_parallel(const char *map, size_t size) {
+    chunk_t *chunks = calloc(args.jobs, sizeof(chunk_t));
+    pthread_t *threads = calloc(args.jobs, sizeof(pthread_t));
+    if (chunks == NULL || threads == NULL) {
+        error_exit("calloc failed");
+    }
 
-    int cur, x = 0, p = 0;
-    while ((cur = fgetc(in)) != EOF) {
-        if (cur == '\t') {
-            p = args.tabstops * (x / args.tabstops + 1);
-            while (x < p) {
-                fputc(' ', args.outfile);
-                x++;
+    size_t start = 0;
+    while (start < size) {
+        long n;
+        for (n = 0; n < args.jobs && start < size; n++) {
+            size_t end = chunk_end(map, size, start);
+            chunks[n].out.kind = SINK_BUFFER;
+            chunks[n].out.stats = output.stats != NULL ? &chunks[n].stats : NULL;
+            memset(&chunks[n].stats, 0, sizeof(expand_stats_t));
+            chunks[n].in = map + start;
+            chunks[n].len = end - start;
+            start = end;
+
+            errno = pthread_create(&threads[n], NULL, expand_chunk_thread, &chunks[n]);
+            if (errno != 0) {
+                error_exit("pthread_create failed");
+            }
+        }
+
+        for (long i = 0; i < n; i++) {
+            pthread_join(threads[i], NULL);
+            write_out(&output, chunks[i].out.buf, chunks[i].out.len);
+            if (output.stats != NULL) {
+                add_stats(output.stats, &chunks[i].stats);
             }
+        }
+    }
+
+    for (long i = 0; i < args.jobs; i++) {
+        free(chunks[i].out.buf);
+    }
+    free(chunks);
+    free(threads);
+}
+
+/**
+ * @brief Thread routine of expand_positioned
+ * @details Takes chunks until none are left. In the counting pass, only the expanded length of
+ * each chunk is determined. In the writing pass, each chunk is expanded to its position in args.outfd.
+ *
+ * @param arg The job_t shared by all threads
+ * @return void* Always NULL
+ */
+static void *expand_jobs(void *arg) {
+    job_t *job = arg;
+    sink_t out = {.kind = SINK_PWRITE, .fd = args.outfd, .cap = PWRITE_SIZE};
+    if (job->offsets != NULL && (out.buf = malloc(out.cap)) == NULL) {
+        error_exit("malloc failed");
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (i >= job->n) {
+            break;
+        }
+
+        chunk_t *c = &job->chunks[i];
+        if (job->offsets == NULL) {
+            c->out.kind = SINK_COUNT;
+            c->out.len = 0;
+            c->out.stats = output.stats != NULL ? &c->stats : NULL;
+            expand_all(&c->out, c->in, c->len);
         } else {
-            x = cur == '\n' ? 0 : x + 1;
-            fputc(cur, args.outfile);
+            out.off = job->offsets[i];
+            /* A chunk without tabs is its own expansion, so the kernel can copy it */
+            size_t copied = 0;
+            if (config.mode == EXPAND_TABS && memchr(c->in, '\t', c->len) == NULL) {
+                copied = copy_span(job->fd, c->in - job->chunks[0].in, args.outfd, &out.off, c->len, 0);
+            }
+            if (copied < c->len) {
+                expand_all(&out, c->in + copied, c->len - copied);
+                flush_sink(&out);
+            }
+        }
+    }
+
+    free(out.buf);
+    return NULL;
+}
+
+/**
+ * @brief Runs expand_jobs on args.jobs threads until all chunks of job are taken
+ *
+ * @param job The job_t to be processed
+ */
+static void run_jobs(job_t *job) {
+    long n = args.jobs < (long)job->n ? args.jobs : (long)job->n;
+    pthread_t threads[n];
+
+    job->next = 0;
+    for (long i = 0; i < n; i++) {
+        errno = pthread_create(&threads[i], NULL, expand_jobs, job);
+        if (errno != 0) {
+            error_exit("pthread_create failed");
+        }
+    }
+    for (long i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/**
+ * @brief Expands a mapped file with args.jobs threads directly into its place inside args.outfd
+ * @details In a first pass, the expanded length of every chunk is counted in parallel. The output
+ * file is then extended by the total length and the prefix sum of the lengths yields the position
+ * of every chunk, so that in a second pass all threads can write with pwrite at the same time.
+ *
+ * @param fd The file descriptor of the mapped file
+ * @param map The mapped file
+ * @param size The size of the mapped file
+ */
+static void expand_positioned(int fd, const char *map, size_t size) {
+    job_t job = {.n = 0, .fd = fd};
+    pthread_mutex_init(&job.lock, NULL);
+
+    for (size_t start = 0; start < size; job.n++) {
+        start = chunk_end(map, size, start);
+    }
+    job.chunks = calloc(job.n, sizeof(chunk_t));
+    if (job.chunks == NULL) {
+        error_exit("calloc failed");
+    }
+    size_t start = 0;
+    for (size_t i = 0; i < job.n; i++) {
+        size_t end = chunk_end(map, size, start);
+        job.chunks[i].in = map + start;
+        job.chunks[i].len = end - start;
+        start = end;
+    }
+
+    run_jobs(&job);
+    for (size_t i = 0; output.stats != NULL && i < job.n; i++) {
+        add_stats(output.stats, &job.chunks[i].stats);
+    }
+
+    /* Everything written through stdio so far has to end up in front of this file */
+    if (fflush(args.outfile) == EOF) {
+        error_exit("fflush failed");
+    }
+    off_t base = lseek(args.outfd, 0, SEEK_END);
+    if (base == -1) {
+        error_exit("lseek failed");
+    }
+
+    job.offsets = malloc(job.n * sizeof(off_t));
+    if (job.offsets == NULL) {
+        error_exit("malloc failed");
+    }
+    for (size_t i = 0; i < job.n; i++) {
+        job.offsets[i] = base;
+        base += job.chunks[i].out.len;
+    }
+    if (ftruncate(args.outfd, base) == -1) {
+        error_exit("ftruncate failed");
+    }
+
+    run_jobs(&job);
+
+    pthread_mutex_destroy(&job.lock);
+    free(job.offsets);
+    free(job.chunks);
+}
+
+/**
+ * @brief Performs the expansion algorithm straight from a read-only mapping of a regular file
+ * @details Only the output file itself is written to by several threads if -j is given. Long tab-free
+ * spans are copied to the output file by the kernel where possible.
+ *
+ * @param out The sink receiving the expanded file
+ * @param fd The file descriptor of the input file
+ * @param size The size of the input file in bytes
+ * @return int 0 on success, -1 if the file could not be mapped
+ */
+static int expand_mapped(sink_t *out, int fd, size_t size) {
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    /* Only a hint for the readahead, so a failure does not matter */
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    if (out == &output && args.jobs > 1 && size > CHUNK_SIZE && args.outfd != -1) {
+        expand_positioned(fd, map, size);
+    } else if (out == &output && args.jobs > 1 && size > CHUNK_SIZE) {
+        expand_parallel(map, size);
+    } else if (out == &output && passthrough != PASS_NONE) {
+        expand_spliced(fd, map, size);
+    } else {
+        expand_all(out, map, size);
+    }
+
+    munmap(map, size);
+    return 0;
+}
+
+/**
+ * @brief Opens an input file, printing a message if that fails or if it is a directory
+ *
+ * @param path The path of the input file
+ * @param st Receives the status of the file
+ * @return int The file descriptor or -1 if the file has to be skipped
+ */
+static int open_input(const char *path, struct stat *st) {
+    int fd = open(path, O_RDONLY);
+    if (fd != -1 && fstat(fd, st) == -1) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd != -1 && S_ISDIR(st->st_mode)) {
+        close(fd);
+        fd = -1;
+        errno = EISDIR;
+    }
+    if (fd == -1) {
+        fprintf(stderr, "Skipping '%s': %s\n", path, strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * @brief Expands the file at path, mapping it if it is a regular file and streaming it otherwise
+ *
+ * @param out The sink receiving the expanded file
+ * @param path The path of the input file
+ */
+static void expand_path(sink_t *out, const char *path) {
+    struct stat st;
+    int fd = open_input(path, &st);
+    if (fd == -1) {
+        return;
+    }
+    expand_stats_t stats;
+    struct timespec start;
+    begin_stats(out, &stats, &start);
+
+    /* Files such as those in /proc claim a size of 0, they have to be streamed */
+    if (S_ISREG(st.st_mode) && st.st_size > 0 && expand_mapped(out, fd, st.st_size) == 0) {
+        close(fd);
+    } else {
+        FILE *in = fdopen(fd, "r");
+        if (in == NULL) {
+            error_exit("fdopen failed");
+        }
+        expand(out, in);
+        fclose(in);
+    }
+    end_stats(out, path, &start);
+}
+
+/**
+ * @brief Atomically replaces the file at path with a new file containing buf
+ * @details The new file is written next to the old one and renamed over it, so readers
+ * never see a partially written file. The permissions of the old file are kept. A symbolic link
+ * is resolved first, so that its target is replaced and the link itself stays.
+ *
+ * @param path The path of the file to be replaced
+ * @param mode The permissions of the file to be replaced
+ * @param buf The new content
+ * @param len The length of the new content
+ * @param st Receives the status of the new file
+ * @return int 0 on success, -1 on failure with errno set
+ */
+static int replace_file(const char *path, mode_t mode, const char *buf, size_t len, struct stat *st) {
+    char *target = realpath(path, NULL);
+    if (target == NULL) {
+        return -1;
+    }
+    char tmp[strlen(target) + sizeof(".XXXXXX")];
+    sprintf(tmp, "%s.XXXXXX", target);
+    int fd = mkstemp(tmp);
+    if (fd == -1) {
+        free(target);
+        return -1;
+    }
+
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1 && errno != EINTR) {
+            break;
+        }
+        if (n > 0) {
+            buf += n;
+            len -= n;
+        }
+    }
+    if (len > 0 || fchmod(fd, mode & 07777) == -1 || fstat(fd, st) == -1 || close(fd) == -1 ||
+        rename(tmp, target) == -1) {
+        int err = errno;
+        if (len > 0) {
+            close(fd);
+        }
+        unlink(tmp);
+        free(target);
+        errno = err;
+        return -1;
+    }
+    free(target);
+    return 0;
+}
+
+/**
+ * @brief Replaces the regular file at path with its expansion
+ * @details Files that would not change are left untouched, and so are binary files. With -c, files whose cache entry
+ * shows that they were normalized (or found to be binary) before are skipped after a single stat, or if they were only
+ * touched, after hashing them.
+ *
+ * @param path The path of the file
+ * @param entry Receives the new cache entry of the file (only with -c, may be NULL otherwise)
+ */
+static void expand_in_place(const char *path, cache_entry_t *entry) {
+    struct stat st;
+    const cache_entry_t *e = NULL;
+    if (args.c != NULL && stat(path, &st) == 0) {
+        if (st.st_dev == cache_st.st_dev && st.st_ino == cache_st.st_ino) {
+            return;
+        }
+        e = cache_find(&cache, &st);
+        if (e != NULL && cache_is_fresh(&cache, e, &st)) {
+            *entry = *e;
+            return;
+        }
+    }
+
+    int fd = open_input(path, &st);
+    if (fd == -1) {
+        return;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Skipping '%s': Not a regular file\n", path);
+        close(fd);
+        return;
+    }
+
+    sink_t out = {.kind = SINK_BUFFER};
+    char *map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Skipping '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return;
+    }
+    if (map != NULL) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    /* The content of a file that was only touched still matches the hash of its normalized form */
+    uint64_t hash = e != NULL ? cache_hash(map, st.st_size) : 0;
+    int changed = e == NULL || hash != e->hash;
+    /* Like git and grep, a file with a NUL byte is taken to be binary, a tab in it is no indentation */
+    if (changed && map != NULL && memchr(map, '\0', st.st_size) != NULL) {
+        fprintf(stderr, "Skipping '%s': Binary file\n", path);
+        if (args.c != NULL && e == NULL) {
+            hash = cache_hash(map, st.st_size);
+        }
+    } else if (changed) {
+        expand_stats_t stats;
+        struct timespec start;
+        begin_stats(&out, &stats, &start);
+        if (map != NULL) {
+            expand_all(&out, map, st.st_size);
+        }
+        end_stats(&out, path, &start);
+
+        /* A tab may become a single space (or the other way round), so the length alone does not tell */
+        if (out.len != (size_t)st.st_size || (out.len > 0 && memcmp(out.buf, map, out.len) != 0)) {
+            if (replace_file(path, st.st_mode, out.buf, out.len, &st) == -1) {
+                fprintf(stderr, "Failed to replace '%s': %s\n", path, strerror(errno));
+                entry = NULL;
+            } else if (args.c != NULL) {
+                hash = cache_hash(out.buf, out.len);
+            }
+        } else if (args.c != NULL && e == NULL) {
+            hash = cache_hash(map, st.st_size);
+        }
+    }
+    if (args.c != NULL && entry != NULL) {
+        cache_set(entry, &st, hash);
+    }
+
+    if (map != NULL) {
+        munmap(map, st.st_size);
+    }
+    close(fd);
+    free(out.buf);
+}
+
+/**
+ * @brief Thread routine of expand_batch
+ * @details Takes files until none are left. With -i, every file is replaced on its own. Otherwise,
+ * the expanded file is handed over to the thread writing the output in argument order.
+ *
+ * @param arg The batch_t shared by all threads
+ * @return void* Always NULL
+ */
+static void *expand_batch_thread(void *arg) {
+    batch_t *batch = arg;
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        while (!args.in_place && batch->next < batch->n && batch->next >= batch->emitted + batch->window) {
+            pthread_cond_wait(&batch->cond, &batch->lock);
+        }
+        size_t i = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+        if (i >= batch->n) {
+            break;
+        }
+
+        if (args.in_place) {
+            expand_in_place(batch->paths[i], batch->entries == NULL ? NULL : &batch->entries[i]);
+            continue;
+        }
+
+        sink_t out = {.kind = SINK_BUFFER};
+        expand_path(&out, batch->paths[i]);
+
+        pthread_mutex_lock(&batch->lock);
+        batch->results[i % batch->window] = out;
+        batch->done[i % batch->window] = 1;
+        pthread_cond_broadcast(&batch->cond);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Expands many files on args.pool threads
+ * @details Without -i, the expanded files are written to the output file in the order of paths
+ *
+ * @param paths The input files
+ * @param n The number of input files
+ * @param entries Receives the new cache entry of every file (only with -c, NULL otherwise)
+ */
+static void expand_batch(char **paths, size_t n, cache_entry_t *entries) {
+    batch_t batch = {.paths = paths, .n = n, .window = BATCH_WINDOW * args.pool, .entries = entries};
+    batch.results = calloc(batch.window, sizeof(sink_t));
+    batch.done = calloc(batch.window, sizeof(int));
+    pthread_t *threads = calloc(args.pool, sizeof(pthread_t));
+    if (batch.results == NULL || batch.done == NULL || threads == NULL) {
+        error_exit("calloc failed");
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.cond, NULL);
+
+    for (long i = 0; i < args.pool; i++) {
+        errno = pthread_create(&threads[i], NULL, expand_batch_thread, &batch);
+        if (errno != 0) {
+            error_exit("pthread_create failed");
+        }
+    }
+
+    if (!args.in_place) {
+        for (size_t i = 0; i < n; i++) {
+            pthread_mutex_lock(&batch.lock);
+            while (!batch.done[i % batch.window]) {
+                pthread_cond_wait(&batch.cond, &batch.lock);
+            }
+            sink_t out = batch.results[i % batch.window];
+            batch.done[i % batch.window] = 0;
+            pthread_mutex_unlock(&batch.lock);
+
+            write_out(&output, out.buf, out.len);
+            free(out.buf);
+
+            /* Only now the slot may be reused */
+            pthread_mutex_lock(&batch.lock);
+            batch.emitted++;
+            pthread_cond_broadcast(&batch.cond);
+            pthread_mutex_unlock(&batch.lock);
+        }
+    }
+
+    for (long i = 0; i < args.pool; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&batch.cond);
+    pthread_mutex_destroy(&batch.lock);
+    free(threads);
+    free(batch.done);
+    free(batch.results);
+}
+
+/**
+ * @brief Appends a path to a list
+ *
+ * @param list The list
+ * @param path The path, allocated with malloc
+ */
+static void add_path(paths_t *list, char *path) {
+    if (list->n == list->cap) {
+        list->cap = list->cap == 0 ? 1024 : list->cap * 2;
+        list->paths = realloc(list->paths, list->cap * sizeof(char *));
+        if (list->paths == NULL) {
+            error_exit("realloc failed");
+        }
+    }
+    list->paths[list->n++] = path;
+}
+
+/**
+ * @brief Adds all regular files below the directory dir to list
+ * @details Symbolic links and the metadata directories of version control systems are skipped.
+ * The type of an entry is taken from the directory itself if possible, so that files are not stat'ed twice.
+ *
+ * @param list The list
+ * @param dir The path of the directory
+ */
+static void collect(paths_t *list, const char *dir) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        fprintf(stderr, "Skipping '%s': %s\n", dir, strerror(errno));
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        const char *name = ent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0 ||
+            strcmp(name, ".hg") == 0 || strcmp(name, ".svn") == 0) {
+            continue;
+        }
+
+        char *path = malloc(strlen(dir) + strlen(name) + 2);
+        if (path == NULL) {
+            error_exit("malloc failed");
+        }
+        sprintf(path, "%s/%s", dir, name);
+
+        unsigned char type = ent->d_type;
+        struct stat st;
+        if (type == DT_UNKNOWN && lstat(path, &st) == 0) {
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+        }
+
+        if (type == DT_REG) {
+            add_path(list, path);
+            continue;
+        }
+        if (type == DT_DIR) {
+            collect(list, path);
         }
+        free(path);
+    }
+    closedir(d);
+}
+
+/**
+ * @brief Replaces the given files and all regular files below the given directories with their expansion
+ * @details With -c, the cache file is loaded before and replaced afterwards
+ *
+ * @param paths The files and directories
+ * @param n The number of files and directories
+ */
+static void expand_tree(char **paths, size_t n) {
+    time_t stamp = time(NULL);
+
+    paths_t list = {.n = 0};
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        if (args.recursive && stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+            collect(&list, paths[i]);
+            continue;
+        }
+        char *path = strdup(paths[i]);
+        if (path == NULL) {
+            error_exit("strdup failed");
+        }
+        add_path(&list, path);
+    }
+
+    /* Everything that has an influence on the content of a normalized file */
+    char settings[64 + (args.t == NULL ? 0 : strlen(args.t))];
+    sprintf(settings, "t=%s u=%d U=%d", args.t == NULL ? "8" : args.t, args.utf8, (int)args.mode);
+    uint64_t settings_hash = cache_hash(settings, strlen(settings));
+
+    cache_entry_t *entries = NULL;
+    if (args.c != NULL) {
+        if (cache_load(&cache, args.c, settings_hash) == -1) {
+            error_exit("Failed to load the cache file");
+        }
+        if (stat(args.c, &cache_st) == -1) {
+            cache_st.st_ino = 0;
+        }
+        entries = calloc(list.n, sizeof(cache_entry_t));
+        if (list.n > 0 && entries == NULL) {
+            error_exit("calloc failed");
+        }
+    }
+
+    expand_batch(list.paths, list.n, entries);
+
+    if (args.c != NULL) {
+        if (cache_save(args.c, settings_hash, stamp, entries, list.n) == -1) {
+            error_exit("Failed to write the cache file");
+        }
+        cache_free(&cache);
+        free(entries);
+    }
+    for (size_t i = 0; i < list.n; i++) {
+        free(list.paths[i]);
+    }
+    free(list.paths);
+}
+
+/**
+ * @brief Signal handler of -f, ends following at the next wakeup
+ *
+ * @param sig The received signal
+ */
+static void stop_following(int sig) {
+    quit = 1;
+}
+
+/**
+ * @brief Writes the complete lines of the pending output of a followed file
+ *
+ * @param f The followed file
+ * @param all Whether an incomplete last line is written as well
+ * @return int Whether anything was written
+ */
+static int follow_emit(follow_t *f, int all) {
+    size_t len = f->pending.len;
+    if (!all && len <= FOLLOW_PENDING_MAX) {
+        const char *nl = memrchr(f->pending.buf, '\n', len);
+        len = nl == NULL ? 0 : (size_t)(nl + 1 - f->pending.buf);
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    write_out(&output, f->pending.buf, len);
+    memmove(f->pending.buf, f->pending.buf + len, f->pending.len - len);
+    f->pending.len -= len;
+    return 1;
+}
+
+/**
+ * @brief Expands everything that was appended to a followed file since the last call
+ * @details A truncated file is expanded from its start again
+ *
+ * @param f The followed file
+ * @param buf A buffer of BLOCK_SIZE bytes
+ * @return int Whether anything was written
+ */
+static int follow_read(follow_t *f, char *buf) {
+    struct stat st;
+    if (fstat(f->fd, &st) == -1) {
+        error_exit("fstat failed");
+    }
+    if (st.st_size < f->off) {
+        fprintf(stderr, "%s: '%s': file truncated\n", args.bin, f->path);
+        expand_flush(&f->state, write_sink, &f->pending);
+        follow_emit(f, 1);
+        if (lseek(f->fd, 0, SEEK_SET) == -1) {
+            error_exit("lseek failed");
+        }
+        f->off = 0;
+    }
+
+    ssize_t n;
+    while ((n = read(f->fd, buf, BLOCK_SIZE)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR && !quit) {
+                continue;
+            }
+            if (errno == EINTR) {
+                break;
+            }
+            error_exit("read failed");
+        }
+        expand_chunk(&f->state, buf, n, write_sink, &f->pending);
+        f->off += n;
+    }
+    expand_drain(&f->state, write_sink, &f->pending);
+    return follow_emit(f, 0);
+}
+
+/**
+ * @brief Expands files and keeps expanding what is appended to them until SIGINT or SIGTERM (-f)
+ * @details Every file has its own column state, and output is only written and flushed in whole lines,
+ * so that lines of different files are not mixed. Files that are not regular are expanded once.
+ *
+ * @param paths The files to be followed
+ * @param n The number of files
+ */
+static void follow(char **paths, size_t n) {
+    struct sigaction sa = {.sa_handler = stop_following};
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGINT, &sa, NULL) == -1 || sigaction(SIGTERM, &sa, NULL) == -1) {
+        error_exit("sigaction failed");
+    }
+
+    int watcher = inotify_init1(IN_CLOEXEC);
+    if (watcher == -1) {
+        error_exit("inotify_init1 failed");
+    }
+    follow_t *files = calloc(n, sizeof(follow_t));
+    char *buf = malloc(BLOCK_SIZE);
+    if (files == NULL || buf == NULL) {
+        error_exit("malloc failed");
+    }
+
+    size_t followed = 0;
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        int fd = open_input(paths[i], &st);
+        if (fd == -1) {
+            continue;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            FILE *in = fdopen(fd, "r");
+            expand(&output, in);
+            fclose(in);
+            continue;
+        }
+
+        follow_t *f = &files[followed];
+        f->path = paths[i];
+        f->fd = fd;
+        f->pending.kind = SINK_BUFFER;
+        f->pending.stats = args.stats ? &f->stats : NULL;
+        expand_init(&f->state, &config);
+        f->state.stats = f->pending.stats;
+        f->wd = inotify_add_watch(watcher, paths[i], IN_MODIFY);
+        if (f->wd == -1) {
+            error_exit("inotify_add_watch failed");
+        }
+        followed++;
+        follow_read(f, buf);
+    }
+    if (fflush(args.outfile) == EOF) {
+        error_exit("fflush failed");
+    }
+
+    /* The signals are only delivered while ppoll waits, so none is lost between testing quit and waiting */
+    sigset_t blocked, unblocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &blocked, &unblocked) == -1) {
+        error_exit("sigprocmask failed");
+    }
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = {.fd = watcher, .events = POLLIN};
+    while (!quit && followed > 0) {
+        if (ppoll(&pfd, 1, NULL, &unblocked) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_exit("ppoll failed");
+        }
+        ssize_t len = read(watcher, events, sizeof(events));
+        if (len == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_exit("read failed");
+        }
+
+        int written = 0;
+        for (char *p = events; p < events + len;) {
+            struct inotify_event *e = (struct inotify_event *)p;
+            for (size_t i = 0; i < followed; i++) {
+                if (files[i].wd == e->wd) {
+                    written |= follow_read(&files[i], buf);
+                }
+            }
+            p += sizeof(struct inotify_event) + e->len;
+        }
+        if (written && fflush(args.outfile) == EOF) {
+            error_exit("fflush failed");
+        }
+    }
+
+    /* Incomplete last lines are still written when following ends */
+    for (size_t i = 0; i < followed; i++) {
+        expand_flush(&files[i].state, write_sink, &files[i].pending);
+        follow_emit(&files[i], 1);
+        if (args.stats) {
+            print_stats(files[i].path, &files[i].stats, &run_start);
+            add_stats(&total, &files[i].stats);
+        }
+        free(files[i].pending.buf);
+        close(files[i].fd);
+    }
+    close(watcher);
+    free(files);
+    free(buf);
+    if (sigprocmask(SIG_SETMASK, &unblocked, NULL) == -1) {
+        error_exit("sigprocmask failed");
     }
 }
 
 int main(int argc, char *argv[]) {
     handle_args(argc, argv);
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
 
     int len = argc - optind;
     if (len == 0) {
-        expand(stdin);
+        expand_stats_t stats;
+        struct timespec start;
+        begin_stats(&output, &stats, &start);
+        expand(&output, stdin);
+        end_stats(&output, "-", &start);
+    } else if (args.in_place) {
+        expand_tree(argv + optind, len);
+    } else if (args.follow) {
+        follow(argv + optind, len);
+    } else if (args.pool > 1) {
+        expand_batch(argv + optind, len, NULL);
     } else {
         for (int i = 0; i < len; i++) {
-            FILE *in = fopen(argv[optind + i], "r");
-            if (in == NULL) {
-                fprintf(stderr, "Skipping '%s': %s\n", argv[optind + i], strerror(errno));
-                continue;
-            }
-            expand(in);
-            fclose(in);
+            expand_path(&output, argv[optind + i]);
         }
     }
 
+    if (args.stats) {
+        print_stats("total", &total, &run_start);
+    }
     fclose(args.outfile);
+    expand_config_free(&config);
+    if (args.outfd != -1) {
+        close(args.outfd);
+    }
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Tests of myexpand that are not covered by comparing it against GNU expand, run by make test
+
+bin=${1:-./myexpand}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+fail() {
+    echo "FAIL: $1"
+    failed=1
+}
+
+# -i on a symbolic link replaces the file it points to and keeps the link
+mkdir "$dir/sub"
+printf 'a\tb\n' > "$dir/sub/target"
+ln -s sub/target "$dir/link"
+"$bin" -i "$dir/link" || fail "-i on a symbolic link exited with $?"
+[ -L "$dir/link" ] || fail "-i replaced the symbolic link with a regular file"
+[ "$(cat "$dir/sub/target")" = "a       b" ] || fail "-i did not expand the target of the symbolic link"
+[ -z "$(find "$dir" -name '*.??????')" ] || fail "-i left a temporary file behind"
+
+# -i and -r leave binary files, which contain a NUL byte, untouched even if they contain tabs
+mkdir "$dir/tree"
+printf '\211PNG\r\n\032\n\0\0\0\rIHDR\0\0\0\t\0\0\0\t\b\002\0\0\0' > "$dir/tree/image.png"
+cp "$dir/tree/image.png" "$dir/image.orig"
+"$bin" -i "$dir/tree/image.png" 2> /dev/null || fail "-i on a binary file exited with $?"
+cmp -s "$dir/tree/image.png" "$dir/image.orig" || fail "-i changed a binary file"
+"$bin" -r "$dir/tree" 2> /dev/null || fail "-r on a binary file exited with $?"
+cmp -s "$dir/tree/image.png" "$dir/image.orig" || fail "-r changed a binary file"
+
+[ $failed -eq 0 ] && echo "All tests passed"
+exit $failed
@@ -0,0 +1,176 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+
+/**
+ * @brief Maps one of the regions of a ring
+ *
+ * @param fd The file descriptor of the ring
+ * @param size The size of the region
+ * @param offset The IORING_OFF_* constant of the region
+ * @return void* The mapping or MAP_FAILED
+ */
+static void *map_region(int fd, size_t size, off_t offset) {
+    return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+}
+
+/**
+ * @brief Prepares a read or write at the current file position
+ *
+ * @param ring The ring
+ * @param op IORING_OP_READ or IORING_OP_WRITE
+ * @param fd The file descriptor
+ * @param buf The buffer
+ * @param len The size of buf
+ * @param tag Identifies the completion
+ */
+static void prepare(uring_t *ring, int op, int fd, const void *buf, size_t len, unsigned long long tag) {
+    unsigned tail = *ring->sq_tail + ring->pending;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)ring->sqes + index;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->off = (unsigned long long)-1;
+    sqe->addr = (unsigned long long)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->user_data = tag;
+    ring->sq_array[index] = index;
+    ring->pending++;
+}
+
+int uring_init(uring_t *ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd == -1) {
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(ring->fd);
+        ring->fd = -1;
+        errno = ENOSYS;
+        return -1;
+    }
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = 0;
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = map_region(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->cq_ring_size == 0 ? ring->sq_ring : map_region(ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    ring->sqes = map_region(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        int err = errno;
+        uring_exit(ring);
+        errno = err;
+        return -1;
+    }
+
+    char *sq = ring->sq_ring, *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = cq + p.cq_off.cqes;
+    return 0;
+}
+
+void uring_read(uring_t *ring, int fd, void *buf, size_t len, unsigned long long tag) {
+    prepare(ring, IORING_OP_READ, fd, buf, len, tag);
+}
+
+void uring_write(uring_t *ring, int fd, const void *buf, size_t len, unsigned long long tag) {
+    prepare(ring, IORING_OP_WRITE, fd, buf, len, tag);
+}
+
+int uring_wait(uring_t *ring, unsigned long long *tag, int *res) {
+    /* The kernel reads the entries only after it sees the new tail, and only when asked to submit them */
+    unsigned submit = ring->pending;
+    if (submit > 0) {
+        __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+        ring->pending = 0;
+    }
+
+    for (;;) {
+        unsigned head = *ring->cq_head;
+        int ready = head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if (ready && submit == 0) {
+            struct io_uring_cqe *cqe = (struct io_uring_cqe *)ring->cqes + (head & *ring->cq_mask);
+            *tag = cqe->user_data;
+            *res = cqe->res;
+            __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+            return 0;
+        }
+
+        long n = syscall(__NR_io_uring_enter, ring->fd, submit, ready ? 0 : 1, ready ? 0 : IORING_ENTER_GETEVENTS,
+                         NULL, 0);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        submit -= n < (long)submit ? n : submit;
+    }
+}
+
+void uring_exit(uring_t *ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd != -1) {
+        close(ring->fd);
+    }
+    ring->fd = -1;
+}
+
+#else
+
+int uring_init(uring_t *ring, unsigned entries) {
+    ring->fd = -1;
+    errno = ENOSYS;
+    return -1;
+}
+
+void uring_read(uring_t *ring, int fd, void *buf, size_t len, unsigned long long tag) {
+}
+
+void uring_write(uring_t *ring, int fd, const void *buf, size_t len, unsigned long long tag) {
+}
+
+int uring_wait(uring_t *ring, unsigned long long *tag, int *res) {
+    errno = ENOSYS;
+    return -1;
+}
+
+void uring_exit(uring_t *ring) {
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+
+/**
+ * @brief A minimal io_uring instance, set up with the raw system calls
+ * @param fd The file descriptor of the ring, -1 if io_uring is not available
+ * @param sq_ring The mapped submission queue ring
+ * @param cq_ring The mapped completion queue ring (may be the same mapping as sq_ring)
+ * @param sqes The mapped submission queue entries
+ * @param sq_ring_size The size of the sq_ring mapping
+ * @param cq_ring_size The size of the cq_ring mapping
+ * @param sqes_size The size of the sqes mapping
+ * @param sq_head, sq_tail, sq_mask, sq_array Pointers into the submission queue ring
+ * @param cq_head, cq_tail, cq_mask, cqes Pointers into the completion queue ring
+ * @param pending The number of prepared entries that have not been submitted yet
+ */
+typedef struct {
+    int fd;
+    void *sq_ring;
+    void *cq_ring;
+    void *sqes;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    void *cqes;
+    unsigned pending;
+} uring_t;
+
+/**
+ * @brief Sets up a ring with room for entries submissions
+ * @details Fails if the kernel does not support io_uring, forbids it, or is too old to read and write
+ * at the current file position (Linux < 5.6)
+ *
+ * @param ring The ring to be set up
+ * @param entries The number of submission queue entries
+ * @return int 0 on success, -1 on failure with errno set
+ */
+int uring_init(uring_t *ring, unsigned entries);
+
+/**
+ * @brief Prepares a read of up to len bytes from the current position of fd
+ *
+ * @param ring The ring
+ * @param fd The file descriptor to be read from
+ * @param buf The buffer, must stay valid until the read completed
+ * @param len The size of buf
+ * @param tag Identifies the completion
+ */
+void uring_read(uring_t *ring, int fd, void *buf, size_t len, unsigned long long tag);
+
+/**
+ * @brief Prepares a write of len bytes to the current position of fd
+ *
+ * @param ring The ring
+ * @param fd The file descriptor to be written to
+ * @param buf The bytes, must stay valid until the write completed
+ * @param len The number of bytes
+ * @param tag Identifies the completion
+ */
+void uring_write(uring_t *ring, int fd, const void *buf, size_t len, unsigned long long tag);
+
+/**
+ * @brief Submits all prepared entries and waits for the next completion
+ *
+ * @param ring The ring
+ * @param tag Receives the tag of the completed entry
+ * @param res Receives the result of the completed entry (bytes transferred or a negative errno)
+ * @return int 0 on success, -1 on failure with errno set
+ */
+int uring_wait(uring_t *ring, unsigned long long *tag, int *res);
+
+/**
+ * @brief Tears down a ring
+ *
+ * @param ring The ring
+ */
+void uring_exit(uring_t *ring);
+
+#endif
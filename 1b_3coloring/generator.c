@@ -1,80 +1,367 @@
 #include <ctype.h>
+#include <sched.h>
+#include <time.h>
 
+#include "rng.h"
 #include "util.h"
 
 /**
- * @brief Parses the command line arguments into graph datastructures for later use
+ * @brief Open-addressing hash sets that make parsing the edges O(E)
+ * @param vertices Vertex index + 1 per slot, hashed by the key of the vertex, 0 marks a free slot
+ * @param vertices_mask The number of vertex slots - 1, a power of two - 1
+ * @param edges Normalized edge (min index << 32 | max index) + 1 per slot, 0 marks a free slot
+ * @param edges_mask The number of edge slots - 1, a power of two - 1
+ */
+typedef struct {
+    uint32_t *vertices;
+    size_t vertices_mask;
+    uint64_t *edges;
+    size_t edges_mask;
+} graph_index_t;
+
+/**
+ * @brief The writing end of the ring of this generator
+ * @details Records are written behind the published head and published in batches, so that the supervisor
+ * is woken up once per batch
+ * @param ring The ring
+ * @param data The records of the ring
+ * @param ring_bytes The number of bytes of records, a power of two
+ * @param published The head that the supervisor can see
+ * @param head The number of bytes written
+ * @param records The number of records written since the last publication
+ * @param first When the first of those records was written, from CLOCK_MONOTONIC
+ */
+typedef struct {
+    ring_t *ring;
+    uint8_t *data;
+    uint32_t ring_bytes;
+    unsigned published;
+    unsigned head;
+    unsigned records;
+    struct timespec first;
+} producer_t;
+
+/**
+ * @brief The state of the min-conflicts local search, which recolors one vertex per step
+ * @details The adjacency is stored as CSR: the neighbors of vertex v are neighbors[offsets[v]..offsets[v + 1]-1],
+ * reached over the edges edge_ids[offsets[v]..offsets[v + 1]-1]. Self loops are kept apart, as they conflict
+ * in every coloring.
+ * @param offsets Where the neighbors of every vertex start, vertices_length + 1 entries
+ * @param neighbors The neighbors of all vertices
+ * @param edge_ids The index of the edge to every neighbor
+ * @param loops The indices of the self loops
+ * @param loops_length The number of self loops
+ * @param conflicts The number of neighbors with the same color as the vertex
+ * @param conflicted The vertices with at least one conflict, in no particular order
+ * @param position The position of every vertex in conflicted, UINT32_MAX if it has no conflict
+ * @param conflicted_length The number of vertices with at least one conflict
+ * @param tabu Per vertex and color, the step until which the vertex must not get that color again
+ * @param total The number of conflicting edges, including the self loops
+ * @param best The fewest conflicting edges since the last restart
+ * @param step The number of steps taken
+ * @param improved The step at which best was last improved
+ * @param reported The length of the shortest solution that was reported
+ */
+typedef struct {
+    uint32_t *offsets;
+    uint32_t *neighbors;
+    uint32_t *edge_ids;
+    uint32_t *loops;
+    size_t loops_length;
+    uint32_t *conflicts;
+    uint32_t *conflicted;
+    uint32_t *position;
+    uint32_t conflicted_length;
+    uint64_t *tabu;
+    size_t total;
+    size_t best;
+    uint64_t step;
+    uint64_t improved;
+    size_t reported;
+} search_t;
+
+/**
+ * @brief Parses the edge arguments into a graph for later use
+ *
+ * @param argc The number of edge arguments
+ * @param argv The edge arguments per se
+ * @param graph A graph from outside with room for argc edges and 2 * argc vertices
+ */
+static void parse_argv(int argc, char *argv[], graph_t *graph);
+
+/**
+ * @brief Returns the slot at which probing for a hashed value starts
+ *
+ * @param x The value to be hashed
+ * @param mask The number of slots - 1
+ * @return size_t The first slot to be probed
+ */
+static inline size_t slot_of(uint64_t x, size_t mask);
+
+/**
+ * @brief Returns the normalized form of an edge that is stored in the edge set
  *
- * @param argc The number of CLI args
- * @param argv The CLI argument values per se
- * @param edges An edges array passed from outside in which the edges are going to be stored
- * @param edges_length A size_t from outside in which the number of usable edges is stored
- * @param vertices A vertex array passed from outside in which the vertices are going to be stored uniquely by their key
- * @param vertices_length A size_t from outside in which the number of unique vertices is stored
+ * @param v1 A vertex index (either left or right)
+ * @param v2 A vertex index (either left or right)
+ * @return uint64_t The smaller index in the upper and the larger one in the lower half, plus 1
  */
-static void parse_argv(int argc, char *argv[],
-                       edge_t edges[], size_t *edges_length,
-                       vertex_t vertices[], size_t *vertices_length);
+static inline uint64_t edge_key(uint32_t v1, uint32_t v2);
 
 /**
- * @brief Adds a new edge (consisting of v1,v2) into the edges array at the position of edges_length
+ * @brief Adds a new edge between the vertex indices v1 and v2 at the end of the edges array
  *
- * @param edges An edges array passed from outside
- * @param edges_length The number of usable edges
- * @param v1 The left vertex of the new edge
- * @param v2 The right vertex of the new edge
+ * @param graph The graph
+ * @param index The hash sets of the graph, the edge is added to them
+ * @param v1 The index of the left vertex of the new edge
+ * @param v2 The index of the right vertex of the new edge
  */
-static void add_new_edge(edge_t edges[], size_t *edges_length, vertex_t *v1, vertex_t *v2);
+static void add_new_edge(graph_t *graph, graph_index_t *index, uint32_t v1, uint32_t v2);
 
 /**
- * @brief Adds a new vertex into the vertices array at the position of vertices_length
+ * @brief Adds a new vertex with the next free index
  *
- * @param vertices A vertex array passed from outside
- * @param vertices_length The number of usable vertices
+ * @param graph The graph
+ * @param index The hash sets of the graph, the vertex is added to them
  * @param key The key that should be used to label the new vertex
- * @return vertex_t* The address of the newly added vertex
+ * @return uint32_t The index of the newly added vertex
  */
-static vertex_t *add_new_vertex(vertex_t vertices[], size_t *vertices_length, long key);
+static uint32_t add_new_vertex(graph_t *graph, graph_index_t *index, uint32_t key);
 
 /**
  * @brief Tries to find edges that already exist by their vertices
  * @details Remember that edges are equal regardless of the order of their vertices
  *
- * @param edges The edges array to be searched
- * @param edges_length The number of usable edges
- * @param v1 A vertex (either left or right)
- * @param v2 A vertex (either left or right)
- * @return edge_t* The address of the found edge or NULL if it was not found
+ * @param index The hash sets of the graph to be searched
+ * @param v1 A vertex index (either left or right)
+ * @param v2 A vertex index (either left or right)
+ * @return int 1 if the edge exists, 0 otherwise
  */
-static edge_t *find_edge_by_vertices(edge_t edges[], size_t edges_length, vertex_t *v1, vertex_t *v2);
+static int find_edge_by_vertices(const graph_index_t *index, uint32_t v1, uint32_t v2);
 
 /**
- * @brief Tries to find vertices that vertices that already exist by their key
+ * @brief Tries to find vertices that already exist by their key
  *
- * @param vertices The vertices array to be searched
- * @param vertices_length The number of usable vertices
+ * @param graph The graph to be searched
+ * @param index The hash sets of the graph
  * @param key The key to be compared
- * @return vertex_t* The address of the found vertex or NULL if it was not found
+ * @param v Receives the index of the found vertex
+ * @return int 1 if the vertex was found, 0 otherwise
+ */
+static int find_vertex_by_key(const graph_t *graph, const graph_index_t *index, uint32_t key, uint32_t *v);
+
+/**
+ * @brief Returns the color of a vertex from the packed colors array
+ *
+ * @param colors The packed colors
+ * @param v The vertex index
+ * @return int The color \in [0..2]
+ */
+static inline int get_color(const uint8_t colors[], uint32_t v);
+
+/**
+ * @brief Sets the color of a vertex in the packed colors array
+ *
+ * @param colors The packed colors
+ * @param v The vertex index
+ * @param color The color \in [0..2]
+ */
+static inline void set_color(uint8_t colors[], uint32_t v, int color);
+
+/**
+ * @brief Returns a random number below n
+ *
+ * @param rng The generator
+ * @param n The bound, at most UINT32_MAX
+ * @return uint32_t The random number \in [0..n-1]
+ */
+static inline uint32_t random_below(rng_t *rng, uint32_t n);
+
+/**
+ * @brief Checks whether no bit of a lane_t is set
+ *
+ * @param lanes The lanes to be checked
+ * @return int 1 if no lane is set, 0 otherwise
+ */
+static int is_empty(lane_t lanes);
+
+/**
+ * @brief Returns the bit of a single lane
+ *
+ * @param lanes The lanes
+ * @param lane The index of the lane \in [0..LANES-1]
+ * @return int The bit of the lane
+ */
+static int lane_bit(lane_t lanes, int lane);
+
+/**
+ * @brief Gives each vertex of the graph a random color in each of the LANES colorings of its planes
+ * @details The colors are drawn 64 at a time with rng_colors
+ *
+ * @param graph The graph to be randomized
+ * @param rng The generator the colors are drawn from
+ */
+static void randomize(graph_t *graph, rng_t *rng);
+
+/**
+ * @brief Returns the lanes whose vertical count (plus overflow) is at least bound
+ *
+ * @param count The planes of the counter, least significant first
+ * @param bits The number of planes of the counter, with 2^bits >= bound
+ * @param overflow The lanes whose count did not fit into the counter
+ * @param bound The number of conflicts that is too many
+ * @return lane_t The lanes with too many conflicts
  */
-static vertex_t *find_vertex_by_key(vertex_t vertices[], size_t vertices_length, long key);
+static lane_t too_many(const lane_t count[], int bits, lane_t overflow, size_t bound);
 
 /**
- * @brief Changes the color of each usable vertex inside the vertices array
+ * @brief Counts the conflicting edges of all LANES colorings in a single pass over the edges
+ * @details Every edge yields a mask of the colorings in which its vertices have the same color.
+ * The masks are summed up in a vertical counter with just enough planes to count to bound, so each lane has
+ * its own count. The pass ends early once every coloring has at least bound conflicts.
  *
- * @param vertices The array of vertices to be randomized
- * @param vertices_length The number of usable vertices
+ * @param graph The graph whose planes are evaluated
+ * @param bound The number of conflicts that is too many
+ * @return int The coloring with the fewest conflicts, -1 if all of them have too many
  */
-static void randomize(vertex_t vertices[], size_t vertices_length);
+static int best_lane(const graph_t *graph, size_t bound);
 
 /**
- * @brief Returns the number of edges that connect vertices with the same color and saves those edges inside the removal_candidates array
+ * @brief Copies one of the colorings of the planes into the packed colors array
  *
- * @param edges The edge array to be searched
- * @param edges_length The number of usable edges
- * @param removal_candidates An array from outside that will be changed inside the function
- * @return size_t The number of edges that connect vertices with the same color (essentially, this can be viewed as removal_candidates_length)
+ * @param graph The graph
+ * @param lane The coloring to be copied
  */
-static size_t set_removal_candidates(edge_t edges[], size_t edges_length, edge_t removal_candidates[]);
+static void extract_lane(graph_t *graph, int lane);
+
+/**
+ * @brief Builds the adjacency of the graph for the local search
+ *
+ * @param search The search to be set up
+ * @param graph The parsed graph
+ */
+static void search_init(search_t *search, const graph_t *graph);
+
+/**
+ * @brief Gives every vertex a new random color and recounts all conflicts
+ *
+ * @param search The search
+ * @param graph The graph whose colors are replaced
+ * @param rng The generator the colors are drawn from
+ */
+static void search_restart(search_t *search, graph_t *graph, rng_t *rng);
+
+/**
+ * @brief Adds a vertex to or removes it from the conflicted vertices, depending on its conflict count
+ *
+ * @param search The search
+ * @param v The vertex whose conflict count changed
+ */
+static inline void search_update(search_t *search, uint32_t v);
+
+/**
+ * @brief Recolors a random conflicted vertex with the color that gives it the fewest conflicts
+ * @details Colors a vertex just left are tabu for a few steps, unless they lead to a new best.
+ * Only the vertex and its neighbors are updated, so a step is O(degree).
+ *
+ * @param search The search, with at least one conflicted vertex
+ * @param graph The graph whose colors are changed
+ * @param rng The generator used to pick the vertex and to break ties
+ */
+static void search_step(search_t *search, graph_t *graph, rng_t *rng);
+
+/**
+ * @brief Runs the local search until it finds a solution shorter than bound and every one it reported before
+ * @details Gives up after SEARCH_STEPS steps, so that the caller can react to signals.
+ * The search restarts from a random coloring if it did not improve for a long time.
+ *
+ * @param search The search
+ * @param graph The graph whose colors are changed
+ * @param rng The generator
+ * @param removal_candidates An array from outside with room for bound - 1 edge indices
+ * @param bound The length that is too long
+ * @return size_t The length of the new solution, bound if none was found
+ */
+static size_t local_search(search_t *search, graph_t *graph, rng_t *rng, size_t removal_candidates[], size_t bound);
+
+/**
+ * @brief Frees the memory held by a search
+ *
+ * @param search The search
+ */
+static void search_free(search_t *search);
+
+/**
+ * @brief Returns the number of edges that connect vertices with the same color and saves the indices of those edges inside the removal_candidates array
+ * @details The edges are scanned in one linear pass. The scan stops as soon as there are bound
+ * such edges, as the solution would not be better than the best one known to the supervisor.
+ *
+ * @param graph The graph to be searched
+ * @param removal_candidates An array from outside with room for bound - 1 edge indices
+ * @param bound The length that is too long
+ * @return size_t The number of edges that connect vertices with the same color, bound if there are at least as many
+ */
+static size_t set_removal_candidates(const graph_t *graph, size_t removal_candidates[], size_t bound);
+
+/**
+ * @brief Makes the records written so far visible to the supervisor, and wakes it up if it sleeps
+ *
+ * @param shm The header of the segment
+ * @param producer The writing end of the ring
+ */
+static void publish(shm_header_t *shm, producer_t *producer);
+
+/**
+ * @brief Waits until the ring has room for bytes more bytes
+ * @details Publishes the written records first, as the supervisor could not make room otherwise
+ *
+ * @param shm The header of the segment
+ * @param producer The writing end of the ring
+ * @param bytes The number of bytes, at most producer->ring_bytes
+ * @return int 1 if there is room, 0 if the generator is terminated before
+ */
+static int reserve(shm_header_t *shm, producer_t *producer, uint32_t bytes);
+
+/**
+ * @brief Writes a solution as a RECORD_U32_PAIRS record behind the head of the ring
+ *
+ * @param shm The header of the segment
+ * @param producer The writing end of the ring
+ * @param graph The graph the solution is for
+ * @param removal_candidates The indices of the edges of the solution
+ * @param length The number of edges of the solution, its record fits into the ring
+ * @return int 0 on success, -1 if the generator is terminated before there is room
+ */
+static int write_record(shm_header_t *shm, producer_t *producer, const graph_t *graph,
+                        const size_t removal_candidates[], size_t length);
+
+/**
+ * @brief Returns the milliseconds passed since an earlier point in time
+ *
+ * @param since The earlier point in time, taken from CLOCK_MONOTONIC
+ * @return long The milliseconds passed
+ */
+static long elapsed_ms(const struct timespec *since);
+
+/* Maximum number of bit planes of the conflict counter of best_lane */
+#define COUNTER_BITS 32
+
+/* Number of steps local_search takes at most per call */
+#define SEARCH_STEPS 65536
+
+/* Minimum number of steps for which a vertex must not get back the color it left */
+#define SEARCH_TENURE 10
+
+/* One in SEARCH_NOISE steps recolors the vertex randomly */
+#define SEARCH_NOISE 32
+
+/* Number of steps without improvement (plus 64 per vertex) after which the local search restarts */
+#define RESTART_STEPS 100000
+
+/* Number of records that are written to the ring before they are published at once */
+#define BATCH_RECORDS 8
+
+/* Milliseconds after which written records are published, even if there are fewer than BATCH_RECORDS */
+#define BATCH_TIMEOUT_MS 10
 
 /* A flag used to break a loop */
 volatile sig_atomic_t quit = 0;
@@ -101,14 +388,46 @@ static void usage(char *msg) {
     if (strlen(msg) != 0) {
         fprintf(stderr, "%s\n", msg);
     }
-    fprintf(stderr, "SYNOPSIS\n\t%s edge [edge...]\nEXAMPLE\n\t%s 0-1 0-2 0-3 1-2 1-3 2-3\n", prog_name, prog_name);
+    fprintf(stderr, "SYNOPSIS\n\t%s [-l] [-s seed] [-S stream] edge [edge...]\nEXAMPLE\n\t%s 0-1 0-2 0-3 1-2 1-3 2-3\n",
+            prog_name, prog_name);
     exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[]) {
     prog_name = argv[0];
 
-    if (argc < 2) {
+    /* Without -s, the time and the process id are a good seed value */
+    uint64_t seed = (uint64_t)time(NULL) << 32 ^ (uint64_t)getpid();
+    unsigned stream = 0;
+    int local = 0;
+    int c;
+    while ((c = getopt(argc, argv, "ls:S:")) != -1) {
+        char *end;
+        switch (c) {
+        case 'l':
+            local = 1;
+            break;
+        case 's':
+            errno = 0;
+            seed = strtoull(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || errno != 0 || optarg[0] == '-') {
+                usage("seed must be a non-negative number");
+            }
+            break;
+        case 'S':
+            errno = 0;
+            unsigned long s = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || errno != 0 || optarg[0] == '-' || s > UINT16_MAX) {
+                usage("stream must be a number in [0..65535]");
+            }
+            stream = s;
+            break;
+        default:
+            usage("");
+        }
+    }
+
+    if (optind == argc) {
         usage("At least one edge must be provided");
     }
 
@@ -118,96 +437,169 @@ int main(int argc, char *argv[]) {
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
 
-    /* The process id is a good seed value */
-    srand(getpid());
+    /* Generators started with the same seed and distinct streams never draw the same numbers */
+    rng_t rng;
+    rng_seed(&rng, seed, stream);
 
-    size_t edges_length = 0;
-    edge_t edges[argc - 1];
-    size_t vertices_length = 0;
-    vertex_t vertices[(argc - 1) * 2];
+    /* Every argument is at most one edge with at most two new vertices */
+    graph_t graph = {.vertices_length = 0, .edges_length = 0};
+    size_t max_vertices = 2 * (size_t)(argc - optind);
+    graph.keys = malloc(max_vertices * sizeof(uint32_t));
+    graph.edges = malloc(2 * (size_t)(argc - optind) * sizeof(uint32_t));
+    graph.colors = calloc((max_vertices + 3) / 4, 1);
+    /* A vector lane_t is loaded and stored with aligned instructions, which malloc's alignment is not enough for */
+    graph.planes = aligned_alloc(sizeof(lane_t), 2 * max_vertices * sizeof(lane_t));
+    if (graph.keys == NULL || graph.edges == NULL || graph.colors == NULL || graph.planes == NULL) {
+        print_errno_msg("malloc failed");
+    }
 
-    parse_argv(argc, argv, edges, &edges_length, vertices, &vertices_length);
+    parse_argv(argc - optind, argv + optind, &graph);
+
+    search_t search;
+    if (local) {
+        search_init(&search, &graph);
+        search_restart(&search, &graph, &rng);
+    }
 
     int fd = shm_open(SHM_NAME, O_RDWR, 0600);
     if (fd == -1) {
         print_errno_msg("shm_open failed");
     }
 
-    cb_t *cb;
-    cb = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (cb == MAP_FAILED) {
+    /* The header tells how large the segment is and how its records are encoded */
+    shm_header_t *shm;
+    shm = mmap(NULL, sizeof(shm_header_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) {
+        print_errno_msg("mmap failed");
+    }
+    if (atomic_load_explicit(&shm->magic, memory_order_acquire) != SHM_MAGIC || shm->version != SHM_VERSION ||
+        shm->encoding != RECORD_U32_PAIRS) {
+        fprintf(stderr, "%s: the shared memory was not set up by a compatible supervisor\n", prog_name);
+        exit(EXIT_FAILURE);
+    }
+    size_t size = shm->size;
+    munmap(shm, sizeof(shm_header_t));
+    shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) {
         print_errno_msg("mmap failed");
     }
 
-    sem_t *free_sem = sem_open(FREE_SEM_NAME, 0);
-    sem_t *used_sem = sem_open(USED_SEM_NAME, 0);
-    sem_t *write_sem = sem_open(WRITE_SEM_NAME, 0);
+    /* Claims a free ring, which only this generator writes to from now on */
+    producer_t producer = {.ring = NULL, .ring_bytes = shm->ring_bytes};
+    for (uint32_t r = 0; r < shm->rings && producer.ring == NULL; r++) {
+        int free_owner = 0;
+        if (atomic_compare_exchange_strong(&shm_ring(shm, r)->owner, &free_owner, getpid())) {
+            producer.ring = shm_ring(shm, r);
+        }
+    }
+    /* Otherwise takes over the ring of a generator that was killed or crashed before it could free it */
+    int reclaimed = 0;
+    for (uint32_t r = 0; r < shm->rings && producer.ring == NULL; r++) {
+        int owner = atomic_load(&shm_ring(shm, r)->owner);
+        if (owner != 0 && kill(owner, 0) == -1 && errno == ESRCH &&
+            atomic_compare_exchange_strong(&shm_ring(shm, r)->owner, &owner, getpid())) {
+            producer.ring = shm_ring(shm, r);
+            reclaimed = 1;
+        }
+    }
+    if (producer.ring == NULL) {
+        fprintf(stderr, "%s: at most %u generators can run at the same time\n", prog_name, shm->rings);
+        munmap(shm, size);
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    producer.data = ring_data(producer.ring);
+    producer.published = producer.head = atomic_load_explicit(&producer.ring->head, memory_order_relaxed);
+    if (reclaimed) {
+        /* The records the dead generator published but the supervisor has not read yet are dropped */
+        atomic_store_explicit(&producer.ring->resync, producer.head, memory_order_relaxed);
+        atomic_store_explicit(&producer.ring->reclaimed, 1, memory_order_release);
+    }
+    producer.records = 0;
 
-    if (used_sem == SEM_FAILED || free_sem == SEM_FAILED || write_sem == SEM_FAILED) {
-        close_sem(free_sem, FREE_SEM_NAME);
-        close_sem(used_sem, USED_SEM_NAME);
-        close_sem(write_sem, WRITE_SEM_NAME);
-        print_errno_msg("sem_open failed");
+    /* A solution can have as many edges as the graph */
+    size_t *removal_candidates = malloc((graph.edges_length + 1) * sizeof(size_t));
+    if (removal_candidates == NULL) {
+        print_errno_msg("malloc failed");
     }
 
-    printf("Started generator with pid %d\n", getpid());
-    while (!quit && cb->signal == 0) {
-        if (sem_wait(write_sem) == -1) {
-            if (errno == EINTR) {
-                continue;
-            }
-            close_sem(free_sem, FREE_SEM_NAME);
-            close_sem(used_sem, USED_SEM_NAME);
-            close_sem(write_sem, WRITE_SEM_NAME);
-            print_errno_msg("sem_wait failed");
-        }
+    printf("Started generator with pid %d (seed %llu, stream %u)\n", getpid(), (unsigned long long)seed, stream);
 
-        if (sem_wait(free_sem) == -1) {
-            if (errno == EINTR) {
-                continue;
+    /* Until the written records are published, the shortest of them bounds the next solutions */
+    size_t written_best = SIZE_MAX;
+    while (!quit && atomic_load(&shm->signal) == 0) {
+        /* Only solutions shorter than the best one the supervisor accepted so far can win,
+         * the others are dropped here without touching the ring */
+        size_t bound = atomic_load_explicit(&shm->best_length, memory_order_relaxed);
+        if (written_best < bound) {
+            bound = written_best;
+        }
+        size_t removal_candidates_length = bound;
+        if (local) {
+            removal_candidates_length = local_search(&search, &graph, &rng, removal_candidates, bound);
+        } else {
+            randomize(&graph, &rng);
+            int lane = best_lane(&graph, bound);
+            if (lane != -1) {
+                extract_lane(&graph, lane);
+                removal_candidates_length = set_removal_candidates(&graph, removal_candidates, bound);
             }
-            close_sem(free_sem, FREE_SEM_NAME);
-            close_sem(used_sem, USED_SEM_NAME);
-            close_sem(write_sem, WRITE_SEM_NAME);
-            print_errno_msg("sem_wait failed");
         }
 
-        randomize(vertices, vertices_length);
-        edge_t removal_candidates[MAXIMUM_SOLUTION_LENGTH];
-        size_t removal_candidates_length = set_removal_candidates(edges, edges_length, removal_candidates);
-        if (removal_candidates_length > MAXIMUM_SOLUTION_LENGTH) {
-            continue;
+        if (removal_candidates_length < bound) {
+            if (write_record(shm, &producer, &graph, removal_candidates, removal_candidates_length) == -1) {
+                break;
+            }
+            written_best = removal_candidates_length;
+            printf("Reported solution with %zu edge(s)\n", removal_candidates_length);
         }
 
-        cb->entries[cb->wr].length = removal_candidates_length;
-        for (int i = 0; i < removal_candidates_length; i++) {
-            cb->entries[cb->wr].from_vertices[i] = removal_candidates[i].v1->key;
-            cb->entries[cb->wr].to_vertices[i] = removal_candidates[i].v2->key;
+        /* A 3-coloring ends the search, so it is not held back */
+        if (producer.records > 0 && (producer.records == BATCH_RECORDS || written_best == 0 ||
+                                     elapsed_ms(&producer.first) >= BATCH_TIMEOUT_MS)) {
+            publish(shm, &producer);
         }
-        cb->wr = (cb->wr + 1) % NUMBER_OF_ENTRIES;
-
-        printf("Reported solution with %zu edge(s)\n", removal_candidates_length);
-        sem_post(used_sem);
-        sem_post(write_sem);
     }
+    publish(shm, &producer);
 
-    if (cb->signal == 1) {
+    if (atomic_load(&shm->signal) == 1) {
         printf("Terminated by order of the supervisor process\n");
     }
 
-    munmap(cb, SHM_SIZE);
+    /* The records that are still in the ring are read by the supervisor all the same */
+    atomic_store(&producer.ring->owner, 0);
+    munmap(shm, size);
     close(fd);
 
-    close_sem(free_sem, FREE_SEM_NAME);
-    close_sem(used_sem, USED_SEM_NAME);
-    close_sem(write_sem, WRITE_SEM_NAME);
+    free(removal_candidates);
+    free(graph.keys);
+    free(graph.edges);
+    free(graph.colors);
+    free(graph.planes);
+    if (local) {
+        search_free(&search);
+    }
 
     printf("Cleaned up all resources\n");
     return EXIT_SUCCESS;
 }
 
-static void parse_argv(int argc, char *argv[], edge_t edges[], size_t *edges_length, vertex_t vertices[], size_t *vertices_length) {
-    for (int i = 1; i < argc; i++) {
+static void parse_argv(int argc, char *argv[], graph_t *graph) {
+    /* At most half of the slots are ever used, which keeps the probe sequences short */
+    graph_index_t index = {.vertices_mask = 1, .edges_mask = 1};
+    while (index.vertices_mask + 1 < 4 * (size_t)argc) {
+        index.vertices_mask = 2 * index.vertices_mask + 1;
+    }
+    while (index.edges_mask + 1 < 2 * (size_t)argc) {
+        index.edges_mask = 2 * index.edges_mask + 1;
+    }
+    index.vertices = calloc(index.vertices_mask + 1, sizeof(uint32_t));
+    index.edges = calloc(index.edges_mask + 1, sizeof(uint64_t));
+    if (index.vertices == NULL || index.edges == NULL) {
+        print_errno_msg("calloc failed");
+    }
+
+    for (int i = 0; i < argc; i++) {
         size_t tokens = 1;
         char *token = strtok(argv[i], "-");
         char *v1_key = token;
@@ -223,75 +615,467 @@ static void parse_argv(int argc, char *argv[], edge_t edges[], size_t *edges_len
         }
 
         char *v1_next, *v2_next;
-        int v1_key_parsed = (int)strtol(v1_key, &v1_next, 10);
-        int v2_key_parsed = (int)strtol(v2_key, &v2_next, 10);
+        errno = 0;
+        unsigned long v1_key_parsed = strtoul(v1_key, &v1_next, 10);
+        unsigned long v2_key_parsed = strtoul(v2_key, &v2_next, 10);
 
-        if (v1_next == v1_key || *v1_next != '\0' || v2_next == v2_key || *v2_next != '\0') {
+        if (v1_next == v1_key || *v1_next != '\0' || v2_next == v2_key || *v2_next != '\0' ||
+            !isdigit((unsigned char)v1_key[0]) || !isdigit((unsigned char)v2_key[0])) {
             usage("vertex keys must consist of digits only");
         }
+        if (errno != 0 || v1_key_parsed > UINT32_MAX || v2_key_parsed > UINT32_MAX) {
+            usage("vertex keys must be at most 4294967295");
+        }
 
-        vertex_t *v1 = find_vertex_by_key(vertices, *vertices_length, v1_key_parsed);
-        if (v1 == NULL) {
-            v1 = add_new_vertex(vertices, vertices_length, v1_key_parsed);
+        uint32_t v1, v2;
+        if (!find_vertex_by_key(graph, &index, v1_key_parsed, &v1)) {
+            v1 = add_new_vertex(graph, &index, v1_key_parsed);
         }
+        if (!find_vertex_by_key(graph, &index, v2_key_parsed, &v2)) {
+            v2 = add_new_vertex(graph, &index, v2_key_parsed);
+        }
+
+        if (!find_edge_by_vertices(&index, v1, v2)) {
+            add_new_edge(graph, &index, v1, v2);
+        }
+    }
+
+    free(index.vertices);
+    free(index.edges);
+}
+
+static inline size_t slot_of(uint64_t x, size_t mask) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x & mask;
+}
+
+static inline uint64_t edge_key(uint32_t v1, uint32_t v2) {
+    return v1 < v2 ? ((uint64_t)v1 << 32 | v2) + 1 : ((uint64_t)v2 << 32 | v1) + 1;
+}
+
+static void add_new_edge(graph_t *graph, graph_index_t *index, uint32_t v1, uint32_t v2) {
+    uint64_t key = edge_key(v1, v2);
+    size_t i = slot_of(key, index->edges_mask);
+    while (index->edges[i] != 0) {
+        i = (i + 1) & index->edges_mask;
+    }
+    index->edges[i] = key;
+
+    graph->edges[2 * graph->edges_length] = v1;
+    graph->edges[2 * graph->edges_length + 1] = v2;
+    graph->edges_length++;
+}
 
-        vertex_t *v2 = find_vertex_by_key(vertices, *vertices_length, v2_key_parsed);
-        if (v2 == NULL) {
-            v2 = add_new_vertex(vertices, vertices_length, v2_key_parsed);
+static uint32_t add_new_vertex(graph_t *graph, graph_index_t *index, uint32_t key) {
+    size_t i = slot_of(key, index->vertices_mask);
+    while (index->vertices[i] != 0) {
+        i = (i + 1) & index->vertices_mask;
+    }
+    index->vertices[i] = graph->vertices_length + 1;
+
+    graph->keys[graph->vertices_length] = key;
+    return graph->vertices_length++;
+}
+
+static int find_edge_by_vertices(const graph_index_t *index, uint32_t v1, uint32_t v2) {
+    uint64_t key = edge_key(v1, v2);
+    for (size_t i = slot_of(key, index->edges_mask); index->edges[i] != 0; i = (i + 1) & index->edges_mask) {
+        if (index->edges[i] == key) {
+            return 1;
         }
+    }
+    return 0;
+}
 
-        edge_t *e = find_edge_by_vertices(edges, *edges_length, v1, v2);
-        if (e == NULL) {
-            add_new_edge(edges, edges_length, v1, v2);
+static int find_vertex_by_key(const graph_t *graph, const graph_index_t *index, uint32_t key, uint32_t *v) {
+    size_t i = slot_of(key, index->vertices_mask);
+    for (; index->vertices[i] != 0; i = (i + 1) & index->vertices_mask) {
+        if (graph->keys[index->vertices[i] - 1] == key) {
+            *v = index->vertices[i] - 1;
+            return 1;
         }
     }
+    return 0;
 }
 
-static void add_new_edge(edge_t edges[], size_t *edges_length, vertex_t *v1, vertex_t *v2) {
-    edges[*edges_length].v1 = v1;
-    edges[*edges_length].v2 = v2;
-    (*edges_length)++;
+static inline int get_color(const uint8_t colors[], uint32_t v) {
+    return (colors[v >> 2] >> ((v & 3) << 1)) & 3;
 }
 
-static vertex_t *add_new_vertex(vertex_t vertices[], size_t *vertices_length, long key) {
-    vertices[*vertices_length].key = key;
-    vertices[*vertices_length].color = 0;
-    (*vertices_length)++;
+static inline void set_color(uint8_t colors[], uint32_t v, int color) {
+    int shift = (v & 3) << 1;
+    colors[v >> 2] = (colors[v >> 2] & ~(3 << shift)) | color << shift;
+}
 
-    return &vertices[*vertices_length - 1];
+static inline uint32_t random_below(rng_t *rng, uint32_t n) {
+    return ((rng_next(rng) >> 32) * n) >> 32;
 }
 
-static edge_t *find_edge_by_vertices(edge_t edges[], size_t edges_length, vertex_t *v1, vertex_t *v2) {
-    for (int i = 0; i < edges_length; i++) {
-        if ((edges[i].v1 == v1 && edges[i].v2 == v2) || (edges[i].v1 == v2 && edges[i].v2 == v1)) {
-            return &edges[i];
+static int is_empty(lane_t lanes) {
+    uint64_t words[LANE_WORDS], any = 0;
+    memcpy(words, &lanes, sizeof(lanes));
+    for (size_t w = 0; w < LANE_WORDS; w++) {
+        any |= words[w];
+    }
+    return any == 0;
+}
+
+static int lane_bit(lane_t lanes, int lane) {
+    uint64_t words[LANE_WORDS];
+    memcpy(words, &lanes, sizeof(lanes));
+    return (words[lane / 64] >> (lane % 64)) & 1;
+}
+
+static void randomize(graph_t *graph, rng_t *rng) {
+    for (uint32_t v = 0; v < graph->vertices_length; v++) {
+        uint64_t hi[LANE_WORDS], lo[LANE_WORDS];
+        for (size_t w = 0; w < LANE_WORDS; w++) {
+            rng_colors(rng, &hi[w], &lo[w]);
         }
+        memcpy(&graph->planes[2 * v], hi, sizeof(lane_t));
+        memcpy(&graph->planes[2 * v + 1], lo, sizeof(lane_t));
     }
-    return NULL;
 }
 
-static vertex_t *find_vertex_by_key(vertex_t vertices[], size_t vertices_length, long key) {
-    for (int i = 0; i < vertices_length; i++) {
-        if (vertices[i].key == key) {
-            return &vertices[i];
+static lane_t too_many(const lane_t count[], int bits, lane_t overflow, size_t bound) {
+    /* Compares the counter with bound - 1 from the most significant bit down, a bound of 0 rejects every lane */
+    if (bound == 0) {
+        return ~(lane_t){0};
+    }
+    lane_t greater = overflow, equal = ~overflow;
+    for (int k = bits - 1; k >= 0; k--) {
+        if (((bound - 1) >> k) & 1) {
+            equal &= count[k];
+        } else {
+            greater |= equal & count[k];
+            equal &= ~count[k];
         }
     }
-    return NULL;
+    return greater;
 }
 
-static void randomize(vertex_t vertices[], size_t vertices_length) {
-    for (int i = 0; i < vertices_length; i++) {
-        vertices[i].color = rand() % 3;
+static int best_lane(const graph_t *graph, size_t bound) {
+    const uint32_t *edges = graph->edges;
+    const lane_t *planes = graph->planes;
+    lane_t count[COUNTER_BITS], overflow;
+    int bits = 1;
+    while (bits < COUNTER_BITS && ((size_t)1 << bits) < bound) {
+        bits++;
+    }
+    memset(count, 0, sizeof(count));
+    memset(&overflow, 0, sizeof(overflow));
+
+    for (size_t i = 0; i < graph->edges_length; i++) {
+        const lane_t *u = &planes[2 * edges[2 * i]], *v = &planes[2 * edges[2 * i + 1]];
+        lane_t carry = ~((u[0] ^ v[0]) | (u[1] ^ v[1]));
+        for (int k = 0; k < bits; k++) {
+            lane_t t = count[k] & carry;
+            count[k] ^= carry;
+            carry = t;
+        }
+        overflow |= carry;
+
+        if ((i & 63) == 63 && is_empty(~too_many(count, bits, overflow, bound))) {
+            return -1;
+        }
+    }
+
+    lane_t alive = ~too_many(count, bits, overflow, bound);
+    int best = -1;
+    size_t best_count = bound;
+    for (int lane = 0; lane < (int)LANES; lane++) {
+        if (!lane_bit(alive, lane)) {
+            continue;
+        }
+        size_t c = 0;
+        for (int k = 0; k < bits; k++) {
+            c |= (size_t)lane_bit(count[k], lane) << k;
+        }
+        if (c < best_count) {
+            best = lane;
+            best_count = c;
+        }
+    }
+    return best;
+}
+
+static void extract_lane(graph_t *graph, int lane) {
+    memset(graph->colors, 0, (graph->vertices_length + 3) / 4);
+    for (uint32_t v = 0; v < graph->vertices_length; v++) {
+        int color = lane_bit(graph->planes[2 * v], lane) << 1 | lane_bit(graph->planes[2 * v + 1], lane);
+        graph->colors[v >> 2] |= color << ((v & 3) << 1);
     }
 }
 
-static size_t set_removal_candidates(edge_t edges[], size_t edges_length, edge_t removal_candidates[]) {
+static size_t set_removal_candidates(const graph_t *graph, size_t removal_candidates[], size_t bound) {
+    const uint32_t *edges = graph->edges;
+    const uint8_t *colors = graph->colors;
     size_t j = 0;
-    for (int i = 0; i < edges_length && j < MAXIMUM_SOLUTION_LENGTH; i++) {
-        if (edges[i].v1->color == edges[i].v2->color) {
-            removal_candidates[j] = edges[i];
-            j++;
+    for (size_t i = 0; i < graph->edges_length; i++) {
+        if (get_color(colors, edges[2 * i]) == get_color(colors, edges[2 * i + 1])) {
+            if (j + 1 >= bound) {
+                return bound;
+            }
+            removal_candidates[j++] = i;
         }
     }
     return j;
 }
+
+static void search_init(search_t *search, const graph_t *graph) {
+    uint32_t n = graph->vertices_length;
+    memset(search, 0, sizeof(*search));
+    search->offsets = calloc((size_t)n + 1, sizeof(uint32_t));
+    search->neighbors = malloc(2 * graph->edges_length * sizeof(uint32_t));
+    search->edge_ids = malloc(2 * graph->edges_length * sizeof(uint32_t));
+    search->loops = malloc(graph->edges_length * sizeof(uint32_t));
+    search->conflicts = malloc(n * sizeof(uint32_t));
+    search->conflicted = malloc(n * sizeof(uint32_t));
+    search->position = malloc(n * sizeof(uint32_t));
+    search->tabu = malloc(3 * (size_t)n * sizeof(uint64_t));
+    if (search->offsets == NULL || search->neighbors == NULL || search->edge_ids == NULL || search->loops == NULL ||
+        search->conflicts == NULL || search->conflicted == NULL || search->position == NULL || search->tabu == NULL) {
+        print_errno_msg("malloc failed");
+    }
+
+    /* Counts the degrees, turns them into start offsets shifted by one, and shifts them back while filling */
+    const uint32_t *edges = graph->edges;
+    for (size_t i = 0; i < graph->edges_length; i++) {
+        if (edges[2 * i] != edges[2 * i + 1]) {
+            search->offsets[edges[2 * i] + 1]++;
+            search->offsets[edges[2 * i + 1] + 1]++;
+        }
+    }
+    for (uint32_t v = 0; v < n; v++) {
+        search->offsets[v + 1] += search->offsets[v];
+    }
+    for (size_t i = 0; i < graph->edges_length; i++) {
+        uint32_t a = edges[2 * i], b = edges[2 * i + 1];
+        if (a == b) {
+            search->loops[search->loops_length++] = i;
+            continue;
+        }
+        search->neighbors[search->offsets[a]] = b;
+        search->edge_ids[search->offsets[a]++] = i;
+        search->neighbors[search->offsets[b]] = a;
+        search->edge_ids[search->offsets[b]++] = i;
+    }
+    for (uint32_t v = n; v > 0; v--) {
+        search->offsets[v] = search->offsets[v - 1];
+    }
+    search->offsets[0] = 0;
+
+    search->reported = SIZE_MAX;
+}
+
+static void search_restart(search_t *search, graph_t *graph, rng_t *rng) {
+    uint32_t n = graph->vertices_length;
+    for (uint32_t v = 0; v < n; v += 64) {
+        uint64_t hi, lo;
+        rng_colors(rng, &hi, &lo);
+        for (uint32_t l = 0; l < 64 && v + l < n; l++) {
+            set_color(graph->colors, v + l, (hi >> l & 1) << 1 | (lo >> l & 1));
+        }
+    }
+
+    search->total = 2 * search->loops_length;
+    search->conflicted_length = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        int color = get_color(graph->colors, v);
+        search->conflicts[v] = 0;
+        for (uint32_t j = search->offsets[v]; j < search->offsets[v + 1]; j++) {
+            search->conflicts[v] += get_color(graph->colors, search->neighbors[j]) == color;
+        }
+        search->total += search->conflicts[v];
+        search->position[v] = UINT32_MAX;
+        search_update(search, v);
+    }
+    /* Every conflicting edge was counted at both of its vertices */
+    search->total /= 2;
+    search->best = search->total;
+    search->improved = search->step;
+    memset(search->tabu, 0, 3 * (size_t)n * sizeof(uint64_t));
+}
+
+static inline void search_update(search_t *search, uint32_t v) {
+    if (search->conflicts[v] > 0 && search->position[v] == UINT32_MAX) {
+        search->position[v] = search->conflicted_length;
+        search->conflicted[search->conflicted_length++] = v;
+    } else if (search->conflicts[v] == 0 && search->position[v] != UINT32_MAX) {
+        uint32_t last = search->conflicted[--search->conflicted_length];
+        search->conflicted[search->position[v]] = last;
+        search->position[last] = search->position[v];
+        search->position[v] = UINT32_MAX;
+    }
+}
+
+static void search_step(search_t *search, graph_t *graph, rng_t *rng) {
+    uint32_t v = search->conflicted[random_below(rng, search->conflicted_length)];
+    int old = get_color(graph->colors, v);
+    uint32_t same[3] = {0, 0, 0};
+    for (uint32_t j = search->offsets[v]; j < search->offsets[v + 1]; j++) {
+        same[get_color(graph->colors, search->neighbors[j])]++;
+    }
+
+    /* The vertex keeps its color unless another one has at most as many conflicts. Tabu colors are only
+     * allowed if they beat the best coloring found so far (aspiration), and now and then a random color is
+     * taken regardless (noise), which gets the search out of plateaus the tabu list alone does not. */
+    int color = old, ties = 1;
+    if (random_below(rng, SEARCH_NOISE) == 0) {
+        color = (old + 1 + random_below(rng, 2)) % 3;
+    } else {
+        for (int c = 0; c < 3; c++) {
+            size_t total = search->total - same[old] + same[c];
+            if (c == old || (search->tabu[3 * (size_t)v + c] > search->step && total >= search->best)) {
+                continue;
+            }
+            if (same[c] < same[color]) {
+                color = c;
+                ties = 1;
+            } else if (same[c] == same[color] && random_below(rng, ++ties) == 0) {
+                color = c;
+            }
+        }
+    }
+    search->step++;
+    if (color == old) {
+        return;
+    }
+
+    search->tabu[3 * (size_t)v + old] = search->step + SEARCH_TENURE + random_below(rng, SEARCH_TENURE);
+    set_color(graph->colors, v, color);
+    for (uint32_t j = search->offsets[v]; j < search->offsets[v + 1]; j++) {
+        uint32_t u = search->neighbors[j];
+        int c = get_color(graph->colors, u);
+        if (c == old) {
+            search->conflicts[u]--;
+            search_update(search, u);
+        } else if (c == color) {
+            search->conflicts[u]++;
+            search_update(search, u);
+        }
+    }
+    search->conflicts[v] = same[color];
+    search_update(search, v);
+    search->total = search->total - same[old] + same[color];
+
+    if (search->total < search->best) {
+        search->best = search->total;
+        search->improved = search->step;
+    }
+}
+
+static size_t local_search(search_t *search, graph_t *graph, rng_t *rng, size_t removal_candidates[], size_t bound) {
+    uint64_t patience = RESTART_STEPS + 64 * (uint64_t)graph->vertices_length;
+    for (int i = 0; i < SEARCH_STEPS; i++) {
+        if (search->total < search->reported && search->total < bound) {
+            /* The conflicting edges are found at their conflicted vertex with the smaller index */
+            size_t j = 0;
+            for (size_t k = 0; k < search->loops_length; k++) {
+                removal_candidates[j++] = search->loops[k];
+            }
+            for (uint32_t k = 0; k < search->conflicted_length; k++) {
+                uint32_t v = search->conflicted[k];
+                int color = get_color(graph->colors, v);
+                for (uint32_t l = search->offsets[v]; l < search->offsets[v + 1]; l++) {
+                    uint32_t u = search->neighbors[l];
+                    if (u > v && get_color(graph->colors, u) == color) {
+                        removal_candidates[j++] = search->edge_ids[l];
+                    }
+                }
+            }
+            search->reported = j;
+            return j;
+        }
+        if (search->conflicted_length == 0) {
+            /* Only self loops are left, which no coloring can remove */
+            break;
+        }
+
+        search_step(search, graph, rng);
+        if (search->step - search->improved > patience) {
+            search_restart(search, graph, rng);
+        }
+    }
+    return bound;
+}
+
+static void search_free(search_t *search) {
+    free(search->offsets);
+    free(search->neighbors);
+    free(search->edge_ids);
+    free(search->loops);
+    free(search->conflicts);
+    free(search->conflicted);
+    free(search->position);
+    free(search->tabu);
+}
+
+static void publish(shm_header_t *shm, producer_t *producer) {
+    if (producer->published == producer->head) {
+        return;
+    }
+    atomic_store_explicit(&producer->ring->head, producer->head, memory_order_release);
+    producer->published = producer->head;
+    producer->records = 0;
+    atomic_fetch_add(&shm->seq, 1);
+    if (atomic_load(&shm->sleeping)) {
+        futex_wake(&shm->seq);
+    }
+}
+
+static int reserve(shm_header_t *shm, producer_t *producer, uint32_t bytes) {
+    ring_t *ring = producer->ring;
+    if (producer->ring_bytes - (producer->head - atomic_load_explicit(&ring->tail, memory_order_acquire)) >= bytes) {
+        return 1;
+    }
+
+    /* A full ring only drains if the supervisor sees the written records and gets CPU time */
+    publish(shm, producer);
+    while (producer->ring_bytes - (producer->head - atomic_load_explicit(&ring->tail, memory_order_acquire)) < bytes) {
+        if (quit || atomic_load(&shm->signal) != 0) {
+            return 0;
+        }
+        sched_yield();
+    }
+    return 1;
+}
+
+static int write_record(shm_header_t *shm, producer_t *producer, const graph_t *graph,
+                        const size_t removal_candidates[], size_t length) {
+    uint32_t offset = producer->head & (producer->ring_bytes - 1);
+    uint32_t bytes = RECORD_BYTES(length);
+    if (offset + bytes > producer->ring_bytes) {
+        /* The record would straddle the end, so the rest of the ring is skipped */
+        if (!reserve(shm, producer, producer->ring_bytes - offset)) {
+            return -1;
+        }
+        *(uint32_t *)(producer->data + offset) = RECORD_WRAP;
+        producer->head += producer->ring_bytes - offset;
+        offset = 0;
+    }
+    if (!reserve(shm, producer, bytes)) {
+        return -1;
+    }
+
+    uint32_t *record = (uint32_t *)(producer->data + offset);
+    record[0] = length;
+    for (size_t i = 0; i < length; i++) {
+        size_t e = removal_candidates[i];
+        record[1 + 2 * i] = graph->keys[graph->edges[2 * e]];
+        record[2 + 2 * i] = graph->keys[graph->edges[2 * e + 1]];
+    }
+    producer->head += bytes;
+    if (producer->records++ == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &producer->first);
+    }
+    return 0;
+}
+
+static long elapsed_ms(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
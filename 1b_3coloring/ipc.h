@@ -1,7 +1,9 @@
 #include <errno.h>
 #include <fcntl.h>
-#include <semaphore.h>
 #include <signal.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,63 +11,102 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-#define NUMBER_OF_ENTRIES 200
-#define MAXIMUM_SOLUTION_LENGTH 8
+#define DEFAULT_RINGS 64         // at most this many generators run at the same time, unless chosen otherwise
+#define DEFAULT_RING_BYTES 4096  // bytes of records per ring, unless chosen otherwise
+#define CACHE_LINE 64
 #define SHM_NAME "/<your matriculation number>_shm"
-#define SHM_SIZE (sizeof(cb_t))
 
-#define FREE_SEM_NAME "/<your matriculation number>_free_sem"
-#define USED_SEM_NAME "/<your matriculation number>_used_sem"
-#define WRITE_SEM_NAME "/<your matriculation number>_write_sem"
+#define SHM_MAGIC 0x4c4f4333u    // "3COL", the first word of the segment once it is set up
+#define SHM_VERSION 2            // layout of the segment
+#define RECORD_U32_PAIRS 1       // record encoding: a uint32_t length n, then n pairs of uint32_t vertex keys
+#define RECORD_WRAP UINT32_MAX   // stands in for the length of a record, the next record starts at offset 0
 
-/**
- * @brief Describes a vertex in a graph
- * @param key The label of a vertex
- * @param color The color of a vertex \in [0..2]
- */
-typedef struct
-{
-    int key;
-    int color;
-} vertex_t;
+/* One bit per coloring that is tried at the same time, 256 of them if compiled with -mavx2 (make LANES=256) */
+#ifdef __AVX2__
+typedef uint64_t lane_t __attribute__((vector_size(32)));
+#else
+typedef uint64_t lane_t;
+#endif
+#define LANES (8 * sizeof(lane_t))
+#define LANE_WORDS (sizeof(lane_t) / sizeof(uint64_t))
 
 /**
- * @brief Describes an edge in a graph
- * @details Addresses are used so that changes to the vertices are immediately available
- * @param v1 Holds the address of the left vertex
- * @param v2 Holds the address of the right vertex
+ * @brief Describes a graph whose vertex keys are remapped to dense indices
+ * @details Vertices are numbered in the order of their first appearance, so that edges and colors
+ * can be stored in flat arrays that are scanned linearly
+ * @param keys The key of every vertex index
+ * @param vertices_length The number of vertices
+ * @param edges The edges as pairs of vertex indices, edge i connects edges[2 * i] and edges[2 * i + 1]
+ * @param edges_length The number of edges
+ * @param colors The color \in [0..2] of every vertex, packed with 2 bits per vertex (4 vertices per byte)
+ * @param planes LANES colorings at once, bit-sliced: planes[2 * v] holds the high and planes[2 * v + 1]
+ * the low bit of the color of vertex v in every coloring
  */
 typedef struct
 {
-    vertex_t *v1;
-    vertex_t *v2;
-} edge_t;
+    uint32_t *keys;
+    uint32_t vertices_length;
+    uint32_t *edges;
+    size_t edges_length;
+    uint8_t *colors;
+    lane_t *planes;
+} graph_t;
 
 /**
- * @brief Describes an entry to the circular buffer
- * @details Can semantically be viewed as a solution
- * @param length The amount of usable vertices
- * @param from_vertices Vertices to the left of the edge definition
- * @param to_vertices Vertices to the right of the edge definition
+ * @brief A single-producer single-consumer ring of records, written by one generator and read by the supervisor
+ * @details head and tail count bytes since the supervisor started and wrap around, byte i is stored at
+ * offset i % ring_bytes of the data that follows the ring_t. Records are aligned to 4 bytes and never
+ * straddle the end of the data, a RECORD_WRAP word fills the rest of the data instead. The producer's
+ * and the consumer's index live on separate cache lines, so they do not invalidate each other's line.
+ * A generator that died without freeing its ring leaves its pid behind, the next generator that finds no free
+ * ring takes such a ring over and asks the supervisor to skip what the dead one left unread.
+ * @param head The number of bytes written, only stored by the generator
+ * @param owner The pid of the generator the ring belongs to, 0 if the ring is free
+ * @param resync The head at which a generator took the ring over from a dead one
+ * @param reclaimed Set after resync was stored, the supervisor clears it and moves the tail to resync
+ * @param tail The number of bytes read, only stored by the supervisor
  */
 typedef struct
 {
-    size_t length;
-    int from_vertices[MAXIMUM_SOLUTION_LENGTH];
-    int to_vertices[MAXIMUM_SOLUTION_LENGTH];
-} cb_entry_t;
+    alignas(CACHE_LINE) atomic_uint head;
+    atomic_int owner;
+    atomic_uint resync;
+    atomic_int reclaimed;
+    alignas(CACHE_LINE) atomic_uint tail;
+} ring_t;
 
 /**
- * @brief The circular buffer per se
+ * @brief The header of the shared memory segment, which describes the rings that follow it
+ * @details The supervisor chooses the number and the size of the rings at startup, generators read them from
+ * here. magic is written last, so a generator that sees SHM_MAGIC sees all other fields.
+ * @param magic SHM_MAGIC once the segment is set up
+ * @param version SHM_VERSION
+ * @param encoding RECORD_U32_PAIRS
+ * @param rings The number of rings
+ * @param ring_bytes The number of bytes of records per ring, a power of two
+ * @param size The size of the whole segment
  * @param signal So that the supervisor can inform the generator(s) to terminate
- * @param rd The current read position
- * @param wr The current write position
- * @param entries An array of fixed size that contains solutions provided by the generator(s)
+ * @param best_length The length of the best solution the supervisor accepted, one more than the longest record
+ * that fits into a ring before the first one. Generators do not report solutions that are not shorter.
+ * @param seq Incremented by a generator after every batch, the supervisor sleeps on it with a futex
+ * @param sleeping Whether the supervisor is (about to go) asleep on seq and has to be woken up
  */
 typedef struct
 {
-    int signal;
-    int rd;
-    int wr;
-    cb_entry_t entries[NUMBER_OF_ENTRIES];
-} cb_t;
+    alignas(CACHE_LINE) atomic_uint magic;
+    uint32_t version;
+    uint32_t encoding;
+    uint32_t rings;
+    uint32_t ring_bytes;
+    uint64_t size;
+    alignas(CACHE_LINE) atomic_int signal;
+    atomic_size_t best_length;
+    alignas(CACHE_LINE) atomic_uint seq;
+    atomic_int sleeping;
+} shm_header_t;
+
+/* The size of a segment with rings rings of ring_bytes bytes each */
+#define SHM_SIZE(rings, ring_bytes) (sizeof(shm_header_t) + (size_t)(rings) * (sizeof(ring_t) + (ring_bytes)))
+
+/* The number of bytes of a record with length edges */
+#define RECORD_BYTES(length) (sizeof(uint32_t) * (1 + 2 * (size_t)(length)))
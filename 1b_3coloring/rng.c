@@ -0,0 +1,80 @@
+#include "rng.h"
+
+/**
+ * @brief Rotates x left by k bits
+ *
+ * @param x The word
+ * @param k The number of bits \in [1..63]
+ * @return uint64_t The rotated word
+ */
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Returns the next output of a splitmix64 generator
+ *
+ * @param x The state of the splitmix64 generator
+ * @return uint64_t The output
+ */
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void rng_seed(rng_t *rng, uint64_t seed, unsigned stream) {
+    /* splitmix64 never yields four zero words in a row, so the state is valid for every seed */
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = splitmix64(&seed);
+    }
+    for (unsigned i = 0; i < stream; i++) {
+        rng_jump(rng);
+    }
+}
+
+uint64_t rng_next(rng_t *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+void rng_jump(rng_t *rng) {
+    static const uint64_t jump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL,
+                                    0x39abdc4529b1661cULL};
+    uint64_t s[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b)) {
+                for (int j = 0; j < 4; j++) {
+                    s[j] ^= rng->s[j];
+                }
+            }
+            rng_next(rng);
+        }
+    }
+    for (int j = 0; j < 4; j++) {
+        rng->s[j] = s[j];
+    }
+}
+
+void rng_colors(rng_t *rng, uint64_t *hi, uint64_t *lo) {
+    uint64_t h = rng_next(rng), l = rng_next(rng);
+    uint64_t invalid = h & l;
+    while (invalid != 0) {
+        h = (h & ~invalid) | (rng_next(rng) & invalid);
+        l = (l & ~invalid) | (rng_next(rng) & invalid);
+        invalid = h & l;
+    }
+    *hi = h;
+    *lo = l;
+}
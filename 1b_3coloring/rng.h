@@ -0,0 +1,52 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/**
+ * @brief The state of a xoshiro256** generator
+ * @details 32 bytes of state, a period of 2^256 - 1, and no hidden state shared with libc
+ * @param s The state words, never all zero
+ */
+typedef struct {
+    uint64_t s[4];
+} rng_t;
+
+/**
+ * @brief Seeds a generator and moves it to the start of one of its streams
+ * @details The state is expanded from the seed with splitmix64. Stream n starts n * 2^128 draws later,
+ * so generators with the same seed and different streams never produce overlapping sequences.
+ *
+ * @param rng The generator to be seeded
+ * @param seed The seed
+ * @param stream The stream
+ */
+void rng_seed(rng_t *rng, uint64_t seed, unsigned stream);
+
+/**
+ * @brief Returns the next 64 random bits
+ *
+ * @param rng The generator
+ * @return uint64_t The random bits
+ */
+uint64_t rng_next(rng_t *rng);
+
+/**
+ * @brief Advances a generator by 2^128 draws
+ *
+ * @param rng The generator
+ */
+void rng_jump(rng_t *rng);
+
+/**
+ * @brief Draws 64 uniform colors \in [0..2] at once, bit-sliced into a high and a low word
+ * @details Bit l of hi and lo is the color of the l-th draw. Two draws give 64 two-bit values,
+ * the ones that came out as 3 are drawn again, so every color has a probability of exactly 1/3.
+ *
+ * @param rng The generator
+ * @param hi Receives the high bits of the colors
+ * @param lo Receives the low bits of the colors
+ */
+void rng_colors(rng_t *rng, uint64_t *hi, uint64_t *lo);
+
+#endif
@@ -1,5 +1,3 @@
-#include <limits.h>
-
 #include "util.h"
 
 /* ASCII color codes */
@@ -32,14 +30,50 @@ static void usage(char *msg) {
     if (strlen(msg) != 0) {
         fprintf(stderr, "%s\n", msg);
     }
-    fprintf(stderr, "Usage: %s\n", prog_name);
+    fprintf(stderr, "Usage: %s [-g generators] [-c bytes]\n", prog_name);
     exit(EXIT_FAILURE);
 }
 
+/**
+ * @brief Parses a number option
+ *
+ * @param arg The argument of the option
+ * @param min The smallest allowed value
+ * @param max The largest allowed value
+ * @param msg The usage message if arg is not a number \in [min..max]
+ * @return uint32_t The number
+ */
+static uint32_t parse_number(const char *arg, unsigned long min, unsigned long max, char *msg) {
+    char *end;
+    errno = 0;
+    unsigned long n = strtoul(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno != 0 || arg[0] == '-' || n < min || n > max) {
+        usage(msg);
+    }
+    return n;
+}
+
 int main(int argc, char *argv[]) {
     prog_name = argv[0];
 
-    if (argc != 1) {
+    uint32_t rings = DEFAULT_RINGS, ring_bytes = DEFAULT_RING_BYTES;
+    int c;
+    while ((c = getopt(argc, argv, "g:c:")) != -1) {
+        switch (c) {
+        case 'g':
+            rings = parse_number(optarg, 1, 4096, "generators must be a number in [1..4096]");
+            break;
+        case 'c':
+            ring_bytes = parse_number(optarg, 64, 1UL << 30, "bytes must be a power of two in [64..2^30]");
+            if ((ring_bytes & (ring_bytes - 1)) != 0) {
+                usage("bytes must be a power of two in [64..2^30]");
+            }
+            break;
+        default:
+            usage("");
+        }
+    }
+    if (optind != argc) {
         usage("Arguments must not be provided");
     }
 
@@ -54,71 +88,90 @@ int main(int argc, char *argv[]) {
         print_errno_msg("shm_open failed");
     }
 
-    if (ftruncate(fd, SHM_SIZE) < 0) {
+    size_t size = SHM_SIZE(rings, ring_bytes);
+    if (ftruncate(fd, size) < 0) {
         print_errno_msg("ftruncate failed");
     }
 
-    cb_t *cb;
-    cb = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (cb == MAP_FAILED) {
+    shm_header_t *shm;
+    shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) {
         print_errno_msg("mmap failed");
     }
 
-    sem_t *free_sem = sem_open(FREE_SEM_NAME, O_CREAT | O_EXCL, 0600, NUMBER_OF_ENTRIES);
-    sem_t *used_sem = sem_open(USED_SEM_NAME, O_CREAT | O_EXCL, 0600, 0);
-    sem_t *write_sem = sem_open(WRITE_SEM_NAME, O_CREAT | O_EXCL, 0600, 1);
-    if (used_sem == SEM_FAILED || free_sem == SEM_FAILED || write_sem == SEM_FAILED) {
-        close_sem(free_sem, FREE_SEM_NAME);
-        close_sem(used_sem, USED_SEM_NAME);
-        close_sem(write_sem, WRITE_SEM_NAME);
-        print_errno_msg("sem_open failed");
-    }
+    /* The segment may be left over from an earlier run, so all rings start out empty and free */
+    memset(shm, 0, size);
+    shm->version = SHM_VERSION;
+    shm->encoding = RECORD_U32_PAIRS;
+    shm->rings = rings;
+    shm->ring_bytes = ring_bytes;
+    shm->size = size;
+    /* The longest record that fits into a ring */
+    size_t best_length = (ring_bytes / sizeof(uint32_t) - 1) / 2 + 1;
+    atomic_store(&shm->best_length, best_length);
+    atomic_store_explicit(&shm->magic, SHM_MAGIC, memory_order_release);
 
     printf("Started supervisor with pid %d\n", getpid());
-    cb_entry_t current_best;
-    current_best.length = INT_MAX;
-    while (!quit) {
-        if (sem_wait(used_sem) == -1) {
-            if (errno == EINTR) {
+    int colorable = 0;
+    while (!quit && !colorable) {
+        /* Drains every ring in turn, giving back all of its bytes with a single store of the tail */
+        unsigned seq = atomic_load(&shm->seq);
+        int found = 0;
+        for (uint32_t r = 0; r < rings && !colorable; r++) {
+            ring_t *ring = shm_ring(shm, r);
+            uint8_t *data = ring_data(ring);
+            unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            /* A generator took the ring over from a dead one, so reading resumes where it started writing */
+            if (atomic_exchange_explicit(&ring->reclaimed, 0, memory_order_acquire)) {
+                tail = atomic_load_explicit(&ring->resync, memory_order_relaxed);
+                atomic_store_explicit(&ring->tail, tail, memory_order_release);
+            }
+            unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            if (tail == head) {
                 continue;
             }
-            close_sem(free_sem, FREE_SEM_NAME);
-            close_sem(used_sem, USED_SEM_NAME);
-            close_sem(write_sem, WRITE_SEM_NAME);
-            print_errno_msg("sem_wait failed");
+            found = 1;
+
+            while (tail != head && !colorable) {
+                uint32_t offset = tail & (ring_bytes - 1);
+                const uint32_t *record = (const uint32_t *)(data + offset);
+                if (record[0] == RECORD_WRAP) {
+                    tail += ring_bytes - offset;
+                    continue;
+                }
+
+                if (record[0] == 0) {
+                    printf("%sThe graph is 3-colorable\n%s", ANSI_COLOR_GREEN, ANSI_COLOR_RESET);
+                    colorable = 1;
+                } else if (record[0] < best_length) {
+                    best_length = record[0];
+                    atomic_store(&shm->best_length, best_length);
+                    printf(ANSI_COLOR_YELLOW);
+                    printf("Solution with %zu edge(s): ", best_length);
+                    print_record(record);
+                    printf(ANSI_COLOR_RESET);
+                }
+                tail += RECORD_BYTES(record[0]);
+            }
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
         }
 
-        if (cb->entries[cb->rd % NUMBER_OF_ENTRIES].length == 0) {
-            printf("%sThe graph is 3-colorable\n%s", ANSI_COLOR_GREEN, ANSI_COLOR_RESET);
-            sem_post(free_sem);
-            break;
-        } else if (cb->entries[cb->rd].length >= current_best.length) {
-            cb->rd = (cb->rd + 1) % NUMBER_OF_ENTRIES;
-            sem_post(free_sem);
-            continue;
-        } else {
-            current_best = cb->entries[cb->rd];
-            printf(ANSI_COLOR_YELLOW);
-            printf("Solution with %zu edge(s): ", cb->entries[cb->rd].length);
-            print_cb_entry_t(cb->entries[cb->rd]);
-            printf(ANSI_COLOR_RESET);
-
-            cb->rd = (cb->rd + 1) % NUMBER_OF_ENTRIES;
-            sem_post(free_sem);
+        /* Generators bump seq after every batch, and wake the supervisor up if it announced to sleep.
+         * A batch published after the scan changed seq, so futex_wait returns right away then. */
+        if (!found && !colorable) {
+            atomic_store(&shm->sleeping, 1);
+            futex_wait(&shm->seq, seq);
+            atomic_store(&shm->sleeping, 0);
         }
     }
 
     /* This will break the loop of the generator(s), which will cause their termination */
-    cb->signal = 1;
+    atomic_store(&shm->signal, 1);
 
-    munmap(cb, SHM_SIZE);
+    munmap(shm, size);
     close(fd);
     shm_unlink(SHM_NAME);
 
-    close_sem(free_sem, FREE_SEM_NAME);
-    close_sem(used_sem, USED_SEM_NAME);
-    close_sem(write_sem, WRITE_SEM_NAME);
-
     printf("Cleaned up all resources\n");
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,12 +1,23 @@
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
 #include "util.h"
 
-void print_cb_entry_t(cb_entry_t e) {
-    for (int i = 0; i < e.length; i++) {
-        printf("%d-%d ", e.from_vertices[i], e.to_vertices[i]);
+void print_record(const uint32_t record[]) {
+    for (uint32_t i = 0; i < record[0]; i++) {
+        printf("%u-%u ", record[1 + 2 * i], record[2 + 2 * i]);
     }
     printf("\n");
 }
 
+ring_t *shm_ring(shm_header_t *shm, uint32_t r) {
+    return (ring_t *)((char *)(shm + 1) + (size_t)r * (sizeof(ring_t) + shm->ring_bytes));
+}
+
+uint8_t *ring_data(ring_t *ring) {
+    return (uint8_t *)(ring + 1);
+}
+
 void print_signal(int signal) {
     if (signal == SIGINT) {
         printf("Handling SIGINT\n");
@@ -25,7 +36,11 @@ void print_errno_msg(char *msg) {
     exit(EXIT_FAILURE);
 }
 
-void close_sem(sem_t *sem, char *name) {
-    sem_close(sem);
-    sem_unlink(name);
+void futex_wait(atomic_uint *word, unsigned value) {
+    /* The futex is shared between processes, so FUTEX_WAIT_PRIVATE must not be used */
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+void futex_wake(atomic_uint *word) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, 1, NULL, NULL, 0);
 }
\ No newline at end of file
@@ -1,11 +1,28 @@
 #include "ipc.h"
 
 /**
- * @brief Prints a cb_entry_t with its details
+ * @brief Prints the edges of a RECORD_U32_PAIRS record
  *
- * @param e The cb_entry_t to be printed
+ * @param record The record, its length followed by the vertex keys of the edges
  */
-void print_cb_entry_t(cb_entry_t e);
+void print_record(const uint32_t record[]);
+
+/**
+ * @brief Returns one of the rings of a shared memory segment
+ *
+ * @param shm The header of the mapped segment
+ * @param r The index of the ring \in [0..shm->rings-1]
+ * @return ring_t* The ring, its ring_data follows it
+ */
+ring_t *shm_ring(shm_header_t *shm, uint32_t r);
+
+/**
+ * @brief Returns the records of a ring
+ *
+ * @param ring The ring
+ * @return uint8_t* The shm->ring_bytes bytes of records
+ */
+uint8_t *ring_data(ring_t *ring);
 
 /**
  * @brief Prints the signum signal iff it is either SIGINT or SIGTERM
@@ -22,9 +39,17 @@ void print_signal(int signal);
 void print_errno_msg(char *msg);
 
 /**
- * @brief Closes and unlinks a named POSIX sem. Useful when clearing resources.
+ * @brief Sleeps as long as a word in shared memory holds value
+ * @details Returns right away if the word does not hold value (anymore), and early on signals
+ *
+ * @param word The word
+ * @param value The value the word is expected to hold
+ */
+void futex_wait(atomic_uint *word, unsigned value);
+
+/**
+ * @brief Wakes up a process that sleeps in futex_wait on a word
  *
- * @param sem The sem
- * @param name The name of the sem
+ * @param word The word
  */
-void close_sem(sem_t *sem, char *name);
\ No newline at end of file
+void futex_wake(atomic_uint *word);
\ No newline at end of file